@@ -1,7 +1,11 @@
 import java.io.IOException;
+import java.util.concurrent.ArrayBlockingQueue;
+import java.util.concurrent.BlockingQueue;
 
 import org.moeaframework.Executor;
+import org.moeaframework.core.FrameworkException;
 import org.moeaframework.core.NondominatedPopulation;
+import org.moeaframework.core.Problem;
 import org.moeaframework.core.Solution;
 import org.moeaframework.core.variable.RealVariable;
 import org.moeaframework.problem.ExternalProblem;
@@ -70,6 +74,76 @@ public class CalHBV {
 		}
 
 	}
+
+	/**
+	 * Pool of SimHBV processes: each ExternalProblem talks to its own child
+	 * process, one solution at a time, so the solutions evaluated
+	 * concurrently by the executor (distributeOn) are dispatched to the idle
+	 * workers and their results are collected in any order.
+	 */
+	public static class myHBVPool implements Problem {
+
+		private final myHBV[] workers;
+
+		private final BlockingQueue<myHBV> idle;
+
+		public myHBVPool(int nWorkers) throws IOException {
+			workers = new myHBV[nWorkers];
+			idle = new ArrayBlockingQueue<myHBV>(nWorkers);
+			for (int i = 0; i < nWorkers; i++) {
+				workers[i] = new myHBV();
+				idle.add(workers[i]);
+			}
+		}
+
+		@Override
+		public void evaluate(Solution solution) {
+			myHBV worker;
+			try {
+				worker = idle.take();
+			} catch (InterruptedException e) {
+				throw new FrameworkException(e);
+			}
+			try {
+				worker.evaluate(solution);
+			} finally {
+				idle.add(worker);
+			}
+		}
+
+		@Override
+		public Solution newSolution() {
+			return workers[0].newSolution();
+		}
+
+		@Override
+		public String getName() {
+			return workers[0].getName();
+		}
+
+		@Override
+		public int getNumberOfVariables() {
+			return workers[0].getNumberOfVariables();
+		}
+
+		@Override
+		public int getNumberOfObjectives() {
+			return workers[0].getNumberOfObjectives();
+		}
+
+		@Override
+		public int getNumberOfConstraints() {
+			return workers[0].getNumberOfConstraints();
+		}
+
+		@Override
+		public void close() {
+			for (myHBV worker : workers) {
+				worker.close();
+			}
+		}
+
+	}
 	
 	public static void main(String[] args) {
 		// seed
@@ -77,6 +151,7 @@ public class CalHBV {
         String alg="NSGAII";
         int nfe=10000;
         float eps = 1;
+        int workers = Runtime.getRuntime().availableProcessors();
         if(args.length > 0){
             try{
                 seed = Long.parseLong(args[0]);
@@ -91,14 +166,28 @@ public class CalHBV {
 				nfe = Integer.parseInt(args[2]);
                 eps = Float.parseFloat(args[3]);
 		}
+		if(args.length > 4){
+				workers = Integer.parseInt(args[4]);
+		}
+
+		//start the SimHBV workers
+		myHBVPool problem = null;
+		try{
+				problem = new myHBVPool(workers);
+		}catch(IOException e){
+				System.err.println("SimHBV could not be started: " + e.getMessage());
+				System.exit(1);
+		}
 
-		//configure and run
+		//configure and run (one evaluation thread per worker)
 		NondominatedPopulation result = new Executor()
-                                .withProblemClass(myHBV.class)
+                                .withProblem(problem)
                                 .withAlgorithm(alg)
                                 .withEpsilon(eps)
                                 .withMaxEvaluations(nfe)
+                                .distributeOn(workers)
 				.run();
+		problem.close();
 		
 				
         //display the results
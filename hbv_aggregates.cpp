@@ -0,0 +1,164 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_aggregates.h"
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace std;
+
+hbv_aggregates::hbv_aggregates(hbv_model *model, string monthlyFile, string annualFile)
+{
+    this->model = model;
+    nRuns = 0;
+
+    // calendar periods of the simulated time steps (the first one is the initial state)
+    MyData data = model->getData();
+    int start = model->getStartingIndex();
+    for(int t=1; t<data.nDays; t++){
+        int year = data.date[start+t][0];
+        int month = data.date[start+t][1];
+        if(months.empty() || months.back().year != year || months.back().month != month){
+            hbv_period p = {year, month, t, t+1};
+            months.push_back(p);
+        }else{
+            months.back().last = t+1;
+        }
+        if(years.empty() || years.back().year != year){
+            hbv_period p = {year, 0, t, t+1};
+            years.push_back(p);
+        }else{
+            years.back().last = t+1;
+        }
+    }
+
+    if(!monthlyFile.empty()){
+        monthly.open(monthlyFile.c_str(), ios::out);
+        if(!monthly){
+            cout << "The monthly aggregates file " << monthlyFile << " could not be created" << endl;
+            exit(1);
+        }
+        monthly << "# run year month steps P AET Q Qmean Qmax date_Qmax" << endl << setprecision(10);
+    }
+    if(!annualFile.empty()){
+        annual.open(annualFile.c_str(), ios::out);
+        if(!annual){
+            cout << "The annual aggregates file " << annualFile << " could not be created" << endl;
+            exit(1);
+        }
+        annual << "# run year steps P AET Q dS loss residual Qmax date_Qmax" << endl << setprecision(10);
+    }
+}
+
+hbv_aggregates::~hbv_aggregates()
+{
+    if(monthly.is_open()) monthly.close();
+    if(annual.is_open()) annual.close();
+}
+
+
+double hbv_aggregates::storage()
+{
+    hbv_snapshot s;
+    model->saveState(s);
+    const double *area = model->getData().zoneArea;
+    double S = s.stw1 + s.stw2;
+    for(unsigned int z=0; z<s.sowat.size(); z++) S += area[z]*(s.sowat[z] + s.sdep[z]);
+    for(unsigned int i=0; i<s.Qrouting.size(); i++) S += s.Qrouting[i];
+    return S;
+}
+
+
+void hbv_aggregates::writeDate(ofstream &out, int t)
+{
+    const int *date = model->getData().date[model->getStartingIndex()+t];
+    out << date[0] << "-" << setfill('0') << setw(2) << date[1] << "-" << setw(2) << date[2];
+    if(model->getTimeStep() < 86400.0) out << "T" << setw(2) << date[3];
+    out << setfill(' ');
+}
+
+
+void hbv_aggregates::run(double *parameters)
+{
+    const double *precip = model->getData().precip + model->getStartingIndex();
+    const double *Qsim = model->getFluxes().Qsim;
+    const double *AET = model->getFluxes().actualET;
+    nRuns++;
+
+    model->start(parameters);
+    double S0 = storage();
+    double P = 0.0, E = 0.0, Q = 0.0, L = 0.0, Qmax = -1.0;
+
+    // the lower reservoir starts from zero at each time step (see
+    // hbv_model::step): its storage at the end of a step leaves the model
+    double Lm = 0.0, stw2 = 0.0;
+    auto lowerReservoir = [&Lm, &stw2](hbv_step &s){
+        Lm += stw2;
+        stw2 = *s.stw2;
+    };
+
+    int tmax = 0;
+    unsigned int y = 0;
+    for(unsigned int m=0; m<months.size(); m++){
+        const hbv_period &p = months[m];
+        Lm = 0.0;
+        model->run(p.first, p.last, lowerReservoir);
+
+        double Pm = 0.0, Em = 0.0, Qm = 0.0, Qmaxm = -1.0;
+        int tmaxm = p.first;
+        for(int t=p.first; t<p.last; t++){
+            Pm += precip[t];
+            Em += AET[t];
+            Qm += Qsim[t];
+            if(Qsim[t] > Qmaxm){
+                Qmaxm = Qsim[t];
+                tmaxm = t;
+            }
+        }
+        if(monthly.is_open()){
+            monthly << nRuns << " " << p.year << " " << p.month << " " << p.last-p.first << " " << Pm << " " << Em
+                    << " " << Qm << " " << Qm/(p.last-p.first) << " " << Qmaxm << " ";
+            writeDate(monthly, tmaxm);
+            monthly << endl;
+        }
+
+        // annual water balance at the end of each year
+        P += Pm;
+        E += Em;
+        Q += Qm;
+        L += Lm;
+        if(Qmaxm > Qmax){
+            Qmax = Qmaxm;
+            tmax = tmaxm;
+        }
+        if(p.last == years[y].last){
+            double S = storage();
+            if(annual.is_open()){
+                annual << nRuns << " " << years[y].year << " " << years[y].last-years[y].first << " " << P << " " << E
+                       << " " << Q << " " << S-S0 << " " << L << " " << P-E-Q-(S-S0)-L << " " << Qmax << " ";
+                writeDate(annual, tmax);
+                annual << endl;
+            }
+            S0 = S;
+            P = E = Q = L = 0.0;
+            Qmax = -1.0;
+            y++;
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_AGGREGATES_H
+#define HBV_AGGREGATES_H
+
+#include "hbv_model.h"
+#include <vector>
+#include <string>
+#include <fstream>
+
+namespace std{
+
+/**
+ * time steps [first, last) of a calendar month or year
+ */
+struct hbv_period
+{
+    int year;
+    int month;  // 0 for a year
+    int first;
+    int last;
+};
+
+/**
+ * Monthly and annual aggregates of a run, computed while the model runs
+ * period by period (no daily output): monthly volumes, mean and maximum
+ * flows (with their date), and the annual water balance, i.e. precipitation,
+ * actual ET and flow volumes (mm), change of the storage (snow, soil,
+ * reservoirs and routing buffer), loss of the lower reservoir (its storage
+ * is discarded at the start of each time step) and the residual
+ * P - AET - Q - dS - loss (rounding errors only). Each
+ * run appends its rows (with the run number) to the monthly and/or annual
+ * files, so large ensembles are reduced to a few rows per year.
+ */
+class hbv_aggregates
+{
+public:
+
+    hbv_aggregates(hbv_model *model, string monthlyFile, string annualFile);
+    virtual ~hbv_aggregates();
+
+    /**
+     * simulate the parameter set (same flows as calc_HBV) and append its
+     * aggregates to the files
+     */
+    void run(double *parameters);
+
+protected:
+
+    // basin storage (mm) at the end of the last simulated time step
+    double storage();
+    void writeDate(ofstream &out, int t);
+
+    hbv_model *model;
+    vector<hbv_period> months;
+    vector<hbv_period> years;
+    ofstream monthly;
+    ofstream annual;
+    long nRuns;
+
+};
+}
+
+#endif // HBV_AGGREGATES_H
@@ -0,0 +1,101 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_bands.h"
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace std;
+
+hbv_bands::hbv_bands(int nSteps, int nThreads, double compression)
+{
+    this->nSteps = nSteps;
+    digests.assign(nThreads > 0 ? nThreads : 1, vector<hbv_digest>(nSteps, hbv_digest(compression)));
+}
+
+int hbv_bands::getSteps()
+{
+    return nSteps;
+}
+
+void hbv_bands::add(int thread, const double *Q, double w)
+{
+    vector<hbv_digest> &d = digests[thread];
+    for(int t=0; t<nSteps; t++) d[t].add(Q[t], w);
+}
+
+void hbv_bands::add(int thread, int step, const double *Q, int n)
+{
+    hbv_digest &d = digests[thread][step];
+    for(int m=0; m<n; m++) d.add(Q[m]);
+}
+
+void hbv_bands::merge()
+{
+    for(unsigned int k=1; k<digests.size(); k++){
+        for(int t=0; t<nSteps; t++) digests[0][t].merge(digests[k][t]);
+        vector<hbv_digest>().swap(digests[k]);
+    }
+    digests.resize(1);
+}
+
+void hbv_bands::pack(vector<double> &buf)
+{
+    merge();
+    buf.clear();
+    for(int t=0; t<nSteps; t++) digests[0][t].pack(buf);
+}
+
+void hbv_bands::unpack(const vector<double> &buf)
+{
+    size_t pos = 0;
+    for(int t=0; t<nSteps && pos < buf.size(); t++) pos += digests[0][t].unpack(&buf[pos]);
+}
+
+void hbv_bands::quantiles(const vector<double> &q, vector<double> &b)
+{
+    merge();
+    int nq = q.size();
+    b.resize((size_t)nSteps*nq);
+    for(int t=0; t<nSteps; t++){
+        for(int j=0; j<nq; j++) b[(size_t)t*nq+j] = digests[0][t].quantile(q[j]);
+    }
+}
+
+void hbv_bands::write(string file, const vector<double> &q)
+{
+    vector<double> b;
+    quantiles(q, b);
+    int nq = q.size();
+    ofstream out(file.c_str(), ios::out);
+    if(!out){
+        cout << "The bands file " << file << " could not be created" << endl;
+        exit(1);
+    }
+    out << "# step";
+    for(int j=0; j<nq; j++) out << " q" << q[j];
+    out << endl << setprecision(10);
+    for(int t=0; t<nSteps; t++){
+        out << t;
+        for(int j=0; j<nq; j++) out << " " << b[(size_t)t*nq+j];
+        out << endl;
+    }
+    out.close();
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_BANDS_H
+#define HBV_BANDS_H
+
+#include "hbv_digest.h"
+#include <vector>
+#include <string>
+
+namespace std{
+
+/**
+ * Quantile bands of an ensemble of flow series: one t-digest per time step
+ * and per thread, so that the threads add their members without
+ * synchronization; the sets of the threads (or of other processes, packed
+ * in a buffer) are merged before the quantiles are computed. The memory
+ * depends on the number of time steps, threads and on the compression, not
+ * on the number of members.
+ */
+class hbv_bands
+{
+public:
+
+    hbv_bands(int nSteps, int nThreads, double compression);
+
+    /**
+     * add a member (flows of all the time steps) with weight w
+     */
+    void add(int thread, const double *Q, double w = 1.0);
+
+    /**
+     * add the flows of n members at one time step
+     */
+    void add(int thread, int step, const double *Q, int n);
+
+    /**
+     * merge the digests of all the threads into the first set
+     */
+    void merge();
+
+    /**
+     * pack the merged digests in a buffer, and merge packed digests
+     */
+    void pack(vector<double> &buf);
+    void unpack(const vector<double> &buf);
+
+    /**
+     * quantiles q of each time step (nSteps x nq, row by row), after merge()
+     */
+    void quantiles(const vector<double> &q, vector<double> &b);
+
+    /**
+     * save the quantiles of each time step in a text file
+     */
+    void write(string file, const vector<double> &q);
+
+    int getSteps();
+
+protected:
+
+    int nSteps;
+    vector<vector<hbv_digest> > digests; // [thread][time step]
+
+};
+}
+
+#endif // HBV_BANDS_H
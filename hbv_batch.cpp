@@ -0,0 +1,199 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_batch.h"
+#include "hbv_monitor.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <cstdlib>
+#include <sys/stat.h>
+
+using namespace std;
+
+hbv_batch::hbv_batch(string manifest, string objectives, int blockSize, unsigned int seed)
+{
+    this->objectives = objectives;
+    this->blockSize = blockSize > 0 ? blockSize : 64;
+    this->seed = seed;
+
+    ifstream in(manifest.c_str(), ios::in);
+    if(!in){
+        cout << "The manifest specified: " << manifest << " could not be found!" << endl;
+        exit(1);
+    }
+    string line;
+    while(getline(in, line)){
+        stringstream ss(line);
+        batch_catchment *c = new batch_catchment();
+        if(!(ss >> c->forcingFile) || c->forcingFile[0] == '#'){
+            delete c;
+            continue;
+        }
+        if(!(ss >> c->paramSource >> c->outputFile)){
+            cout << "Invalid line of the manifest " << manifest << ": " << line << endl;
+            exit(1);
+        }
+
+        struct stat st;
+        if(stat(c->forcingFile.c_str(), &st) != 0){
+            cout << "The input file specified: " << c->forcingFile << " could not be found!" << endl;
+            exit(1);
+        }
+        c->cost = st.st_size;
+        c->design = NULL;
+        c->model = NULL;
+        c->metrics = NULL;
+
+        // parameter sets
+        string &p = c->paramSource;
+        size_t colon = p.find(':');
+        bool binary = p.size() > 4 && p.compare(p.size()-4, 4, ".bin") == 0;
+        if(colon != string::npos || binary){
+            long n = colon != string::npos ? atol(p.substr(colon+1).c_str()) : 0;
+            c->design = new hbv_design(colon != string::npos ? p.substr(0, colon) : p, hbv_model::nParams,
+                                       hbv_model::paramMin, hbv_model::paramMax, n, seed);
+            c->nSets = c->design->size();
+        }else{
+            ifstream pin(p.c_str(), ios::in);
+            if(!pin){
+                cout << "The parameter file specified: " << p << " could not be found!" << endl;
+                exit(1);
+            }
+            double x;
+            while(pin >> x) c->textParams.push_back(x);
+            c->nSets = c->textParams.size() / hbv_model::nParams;
+        }
+
+        c->remaining = (c->nSets + this->blockSize - 1) / this->blockSize;
+        catchments.push_back(c);
+    }
+
+    // the longest records first, so that the short ones fill the gaps at the end
+    vector<int> order(catchments.size());
+    for(unsigned int i=0; i<order.size(); i++) order[i] = i;
+    stable_sort(order.begin(), order.end(), [this](int a, int b){ return catchments[a]->cost > catchments[b]->cost; });
+    for(unsigned int k=0; k<order.size(); k++){
+        for(long b=0; b<catchments[order[k]]->remaining; b++) tasks.push_back(make_pair(order[k], b));
+    }
+}
+
+hbv_batch::~hbv_batch()
+{
+    for(unsigned int i=0; i<catchments.size(); i++){
+        delete catchments[i]->design;
+        delete catchments[i];
+    }
+}
+
+
+void hbv_batch::run(int nThreads, bool affinity)
+{
+    // catchments without parameter sets are completed immediately
+    for(unsigned int i=0; i<catchments.size(); i++){
+        if(catchments[i]->remaining == 0) finish(catchments[i]);
+    }
+
+    hbv_scheduler scheduler(nThreads, affinity);
+    for(unsigned int i=0; i<catchments.size(); i++){
+        catchments[i]->threadModels.assign(scheduler.getNumberOfThreads(), NULL);
+    }
+    vector<int> ids(tasks.size());
+    for(unsigned int i=0; i<ids.size(); i++) ids[i] = i;
+    scheduler.run(ids, [this](int thread, int id){
+        batch_catchment *c = catchments[tasks[id].first];
+        long first = tasks[id].second*blockSize;
+        call_once(c->loaded, &hbv_batch::load, this, c, thread);
+        evaluate(c, thread, first, min(first + blockSize, c->nSets));
+        if(--c->remaining == 0) finish(c);
+    });
+}
+
+
+void hbv_batch::load(batch_catchment *c, int thread)
+{
+    c->model = new hbv_model(c->forcingFile);
+    c->model->setStoreStates(false);
+    c->threadModels[thread] = c->model;
+    hbv_span Qobs(c->model->getData().flow, c->model->getData().nDays);
+    hbv_span precip(c->model->getData().precip, c->model->getData().nDays);
+    c->metrics = new hbv_metrics(objectives, Qobs, precip, c->model->getWarmup());
+    c->objs.resize(c->nSets*c->metrics->size());
+}
+
+
+void hbv_batch::evaluate(batch_catchment *c, int thread, long first, long last)
+{
+    // each thread simulates with its own states, sharing the forcing (the
+    // copy is created by its first task of the catchment)
+    if(c->threadModels[thread] == NULL){
+        c->threadModels[thread] = new hbv_model(c->model);
+        c->threadModels[thread]->setStoreStates(false);
+    }
+    hbv_model &model = *c->threadModels[thread];
+    int nDays = model.getData().nDays;
+    int nobjs = c->metrics->size();
+    double vars[hbv_model::nParams];
+
+    for(long i=first; i<last; i++){
+        if(c->design != NULL) c->design->get(i, vars);
+        else copy(&c->textParams[i*hbv_model::nParams], &c->textParams[(i+1)*hbv_model::nParams], vars);
+        chrono::steady_clock::time_point t0 = hbv_stats::start();
+        model.calc_HBV(vars);
+        c->metrics->evaluate(hbv_span(model.getFluxes().Qsim, nDays), &c->objs[i*nobjs]);
+        hbv_stats::evaluation(t0, nDays);
+    }
+}
+
+
+void hbv_batch::finish(batch_catchment *c)
+{
+    // one row of objectives per parameter set
+    ofstream out(c->outputFile.c_str(), ios::out);
+    if(!out){
+        cout << "The output file " << c->outputFile << " could not be created" << endl;
+        exit(1);
+    }
+    out << setprecision(17);
+    int nobjs = c->metrics != NULL ? c->metrics->size() : 0;
+    for(long i=0; i<c->nSets; i++){
+        for(int m=0; m<nobjs; m++) out << c->objs[i*nobjs+m] << (m < nobjs-1 ? " " : "");
+        out << endl;
+    }
+    out.close();
+
+    // release the states of the threads and the forcing data
+    for(unsigned int t=0; t<c->threadModels.size(); t++){
+        hbv_model *model = c->threadModels[t];
+        if(model == NULL || model == c->model) continue;
+        model->hbv_delete(model->getData().nDays);
+        delete model;
+    }
+    vector<hbv_model*>().swap(c->threadModels);
+    if(c->model != NULL){
+        c->model->hbv_delete(c->model->getData().nDays);
+        delete c->model;
+        delete c->metrics;
+        c->model = NULL;
+        c->metrics = NULL;
+    }
+    vector<double>().swap(c->objs);
+    vector<double>().swap(c->textParams);
+}
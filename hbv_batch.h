@@ -0,0 +1,92 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_BATCH_H
+#define HBV_BATCH_H
+
+#include "hbv_model.h"
+#include "hbv_metrics.h"
+#include "hbv_sampling.h"
+#include "hbv_scheduler.h"
+#include <vector>
+#include <string>
+#include <mutex>
+#include <atomic>
+
+namespace std{
+
+/**
+ * catchment of a batch run (one line of the manifest); the forcing data are
+ * loaded by the first task and released after the last one
+ */
+struct batch_catchment
+{
+    string forcingFile;
+    string paramSource;
+    string outputFile;
+    long nSets;             // number of parameter sets
+    double cost;            // relative cost of a parameter set (size of the forcing)
+
+    vector<double> textParams;  // parameter sets read from a text file
+    hbv_design *design;         // or generated / mapped
+    hbv_model *model;
+    vector<hbv_model*> threadModels;    // states of each thread, sharing the forcing of model
+    hbv_metrics *metrics;
+    vector<double> objs;        // nSets x nobjs
+    once_flag loaded;
+    atomic<int> remaining;      // blocks still to be evaluated
+};
+
+/**
+ * Batch runs of many catchments, each with many parameter sets, listed in a
+ * manifest with one line per catchment:
+ *   forcing_file parameters output_file
+ * where parameters is a text file (one set per row), a binary N x 12 matrix
+ * (*.bin) or a generated design (lhs:N or sobol:N). The (catchment x block
+ * of parameter sets) tasks run on a work-stealing pool, starting from the
+ * longest records, and the objectives of each catchment are written (one row
+ * per parameter set) as soon as all its blocks are evaluated.
+ */
+class hbv_batch
+{
+public:
+
+    hbv_batch(string manifest, string objectives, int blockSize, unsigned int seed);
+    virtual ~hbv_batch();
+
+    void run(int nThreads, bool affinity);
+
+protected:
+
+    void load(batch_catchment *c, int thread);
+    void evaluate(batch_catchment *c, int thread, long first, long last);
+    void finish(batch_catchment *c);
+
+    string objectives;
+    int blockSize;
+    unsigned int seed;
+    vector<batch_catchment*> catchments;
+
+    // task i is the block tasks[i].second of catchment tasks[i].first
+    vector<pair<int, long> > tasks;
+
+};
+}
+
+#endif // HBV_BATCH_H
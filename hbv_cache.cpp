@@ -0,0 +1,307 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_cache.h"
+#include "hbv_model.h"
+#include "hbv_monitor.h"
+#include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+#define CACHE_MAGIC 0x43564248  // "HBVC"
+#define CACHE_VERSION 2
+#define CACHE_MIN_CAPACITY 1024
+
+hbv_cache::hbv_cache(string filename, string forcingFile, string objectives, int nobjs, double resolution, bool storeTraces, bool fastPow)
+{
+    this->filename = filename;
+    this->nobjs = nobjs;
+    this->resolution = resolution;
+    this->storeTraces = storeTraces;
+    hits = 0;
+    misses = 0;
+    nEntries = 0;
+
+    // results depend on the forcing data, on the selected objectives and on
+    // the approximation of pow; the records depend on the format and on the
+    // quantization of the parameters
+    int32_t version = CACHE_VERSION;
+    int32_t fast = fastPow;
+    baseKey = hashFile(forcingFile);
+    baseKey = hashBytes(baseKey, &version, sizeof(version));
+    baseKey = hashBytes(baseKey, objectives.c_str(), objectives.size());
+    baseKey = hashBytes(baseKey, &resolution, sizeof(resolution));
+    baseKey = hashBytes(baseKey, &fast, sizeof(fast));
+
+    fd = open(filename.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if(fd < 0){
+        cout << "The cache file specified: " << filename << " could not be opened!" << endl;
+        exit(1);
+    }
+    load();
+}
+
+hbv_cache::~hbv_cache()
+{
+    close(fd);
+    for(unsigned int i=0; i<tables.size(); i++){
+        delete[] tables[i]->slotKeys;
+        delete[] tables[i]->slotOffsets;
+        delete tables[i];
+    }
+}
+
+bool hbv_cache::storesTraces()
+{
+    return storeTraces;
+}
+
+long hbv_cache::getHits()
+{
+    return hits;
+}
+
+long hbv_cache::getMisses()
+{
+    return misses;
+}
+
+long hbv_cache::getSize()
+{
+    return nEntries;
+}
+
+
+uint64_t hbv_cache::hashBytes(uint64_t h, const void *data, size_t n)
+{
+    // FNV-1a
+    const unsigned char *p = (const unsigned char*)data;
+    for(size_t i=0; i<n; i++){
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t hbv_cache::hashFile(string filename)
+{
+    uint64_t h = 14695981039346656037ULL;
+    char buffer[65536];
+    ifstream in(filename.c_str(), ios::in | ios::binary);
+    while(in){
+        in.read(buffer, sizeof(buffer));
+        h = hashBytes(h, buffer, in.gcount());
+    }
+    return h;
+}
+
+hbv_cache_key hbv_cache::makeKey(const double *vars)
+{
+    hbv_cache_key key;
+    uint64_t h = baseKey;
+    for(int i=0; i<hbv_model::nParams; i++){
+        double range = hbv_model::paramMax[i] - hbv_model::paramMin[i];
+        key.q[i] = llround((vars[i] - hbv_model::paramMin[i])/range/resolution);
+    }
+    h = hashBytes(h, key.q, sizeof(key.q));
+    // final mixing (splitmix64); 0 marks the empty slots
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    key.hash = h == 0 ? 1 : h;
+    return key;
+}
+
+
+bool hbv_cache::readHeader(int64_t offset, record_header &h)
+{
+    if(pread(fd, &h, sizeof(h), offset) != sizeof(h)) return false;
+    return h.magic == CACHE_MAGIC && h.size >= sizeof(h);
+}
+
+void hbv_cache::load()
+{
+    // scan the existing records (a truncated last record is ignored)
+    vector<uint64_t> keys;
+    vector<int64_t> offsets;
+    int64_t end = lseek(fd, 0, SEEK_END);
+    int64_t offset = 0;
+    record_header h;
+    while(offset < end && readHeader(offset, h) && offset + h.size <= end){
+        if(h.nobjs == nobjs && h.nvars == hbv_model::nParams){
+            keys.push_back(h.key);
+            offsets.push_back(offset);
+        }
+        offset += h.size;
+    }
+
+    uint64_t capacity = CACHE_MIN_CAPACITY;
+    while(capacity < 4*keys.size()) capacity *= 2;
+    index = newTable(capacity);
+    for(unsigned int i=0; i<keys.size(); i++){
+        publish(keys[i], offsets[i]);
+    }
+}
+
+hbv_cache::index_table *hbv_cache::newTable(uint64_t capacity)
+{
+    index_table *t = new index_table;
+    t->capacity = capacity;
+    t->slotKeys = new atomic<uint64_t>[capacity];
+    t->slotOffsets = new atomic<int64_t>[capacity];
+    for(uint64_t i=0; i<capacity; i++){
+        t->slotKeys[i] = 0;
+        t->slotOffsets[i] = -1;
+    }
+    tables.push_back(t);
+    return t;
+}
+
+void hbv_cache::publish(uint64_t key, int64_t offset)
+{
+    // called by a single writer (load or under writeMutex)
+    index_table *t = index.load(memory_order_relaxed);
+    if(nEntries + 1 > (long)(t->capacity/2)){
+        // copy the slots into a table twice as large, then publish it: the
+        // lookups still running on the old table find the older records
+        index_table *grown = newTable(2*t->capacity);
+        for(uint64_t i=0; i<t->capacity; i++){
+            uint64_t k = t->slotKeys[i].load(memory_order_relaxed);
+            if(k == 0) continue;
+            uint64_t j = k & (grown->capacity-1);
+            while(grown->slotKeys[j].load(memory_order_relaxed) != 0) j = (j+1) & (grown->capacity-1);
+            grown->slotOffsets[j].store(t->slotOffsets[i].load(memory_order_relaxed), memory_order_relaxed);
+            grown->slotKeys[j].store(k, memory_order_relaxed);
+        }
+        index.store(grown, memory_order_release);
+        t = grown;
+    }
+
+    uint64_t i = key & (t->capacity-1);
+    while(true){
+        uint64_t k = t->slotKeys[i].load(memory_order_acquire);
+        // a different parameter set with the same hash is not indexed (it is
+        // simulated again, see readRecord)
+        if(k == key) return;
+        if(k == 0){
+            // the offset is visible before the key
+            t->slotOffsets[i].store(offset, memory_order_relaxed);
+            t->slotKeys[i].store(key, memory_order_release);
+            nEntries++;
+            return;
+        }
+        i = (i+1) & (t->capacity-1);
+    }
+}
+
+int64_t hbv_cache::find(uint64_t key)
+{
+    index_table *t = index.load(memory_order_acquire);
+    uint64_t i = key & (t->capacity-1);
+    while(true){
+        uint64_t k = t->slotKeys[i].load(memory_order_acquire);
+        if(k == key) return t->slotOffsets[i].load(memory_order_relaxed);
+        if(k == 0) return -1;
+        i = (i+1) & (t->capacity-1);
+    }
+}
+
+bool hbv_cache::readRecord(const hbv_cache_key &key, int64_t &offset, record_header &h, double *objs)
+{
+    // quantized parameters and objectives of the record of the key, if its
+    // parameters are those of the key (not a collision of the hashes)
+    offset = find(key.hash);
+    if(offset < 0 || !readHeader(offset, h) || h.key != key.hash || h.nvars != hbv_model::nParams) return false;
+    int64_t q[hbv_model::nParams];
+    ssize_t bytes = sizeof(q);
+    if(pread(fd, q, bytes, offset + sizeof(h)) != bytes || memcmp(q, key.q, sizeof(q)) != 0) return false;
+    bytes = nobjs*sizeof(double);
+    return objs == NULL || pread(fd, objs, bytes, offset + sizeof(h) + sizeof(q)) == bytes;
+}
+
+
+bool hbv_cache::lookup(const hbv_cache_key &key, double *objs)
+{
+    int64_t offset;
+    record_header h;
+    if(!readRecord(key, offset, h, objs)){
+        misses++;
+        hbv_stats::add(hbv_stats::cacheMisses);
+        return false;
+    }
+    hits++;
+    hbv_stats::add(hbv_stats::cacheHits);
+    return true;
+}
+
+bool hbv_cache::lookupTrace(const hbv_cache_key &key, vector<double> &trace)
+{
+    int64_t offset;
+    record_header h;
+    if(!readRecord(key, offset, h, NULL) || h.traceBytes == 0) return false;
+
+    vector<unsigned char> compressed(h.traceBytes);
+    int64_t start = offset + sizeof(h) + sizeof(key.q) + nobjs*sizeof(double);
+    if(pread(fd, &compressed[0], h.traceBytes, start) != h.traceBytes) return false;
+    trace.resize(h.traceLength);
+    uLongf length = h.traceLength*sizeof(double);
+    return uncompress((Bytef*)&trace[0], &length, &compressed[0], h.traceBytes) == Z_OK;
+}
+
+void hbv_cache::insert(const hbv_cache_key &key, const double *objs, const double *trace, int traceLength)
+{
+    // record: header, quantized parameters, objectives, compressed trace
+    vector<unsigned char> compressed;
+    uLongf traceBytes = 0;
+    if(storeTraces && trace != NULL && traceLength > 0){
+        traceBytes = compressBound(traceLength*sizeof(double));
+        compressed.resize(traceBytes);
+        if(compress2(&compressed[0], &traceBytes, (const Bytef*)trace, traceLength*sizeof(double), Z_BEST_SPEED) != Z_OK){
+            traceBytes = 0;
+        }
+    }
+
+    record_header h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CACHE_MAGIC;
+    h.key = key.hash;
+    h.nobjs = nobjs;
+    h.traceBytes = traceBytes;
+    h.traceLength = traceBytes > 0 ? traceLength : 0;
+    h.nvars = hbv_model::nParams;
+    size_t objStart = sizeof(h) + sizeof(key.q);
+    h.size = objStart + nobjs*sizeof(double) + traceBytes;
+
+    vector<unsigned char> buffer(h.size);
+    memcpy(&buffer[0], &h, sizeof(h));
+    memcpy(&buffer[sizeof(h)], key.q, sizeof(key.q));
+    memcpy(&buffer[objStart], objs, nobjs*sizeof(double));
+    if(traceBytes > 0) memcpy(&buffer[objStart + nobjs*sizeof(double)], &compressed[0], traceBytes);
+
+    // one write per record (O_APPEND): records of concurrent processes are not interleaved
+    lock_guard<mutex> lock(writeMutex);
+    if(write(fd, &buffer[0], h.size) != (ssize_t)h.size) return;
+    publish(key.hash, lseek(fd, 0, SEEK_CUR) - h.size);
+}
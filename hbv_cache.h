@@ -0,0 +1,139 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_CACHE_H
+#define HBV_CACHE_H
+
+#include "hbv_model.h"
+#include <string>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+
+namespace std{
+
+/**
+ * parameter vector quantized with the resolution of the cache (stored in the
+ * records and compared on lookup) and its hash (index of the records)
+ */
+struct hbv_cache_key
+{
+    uint64_t hash;
+    int64_t q[hbv_model::nParams];
+};
+
+/**
+ * persistent store of evaluated parameter sets: an append-only file of
+ * records (key, quantized parameters, objectives and optionally the
+ * compressed simulated flows) indexed in memory by an open-addressing hash
+ * table.
+ * The key is a hash of the format version, of the forcing file, of the
+ * objectives, of the settings changing the results (resolution, fast pow)
+ * and of the parameter vector quantized with the given resolution (fraction
+ * of the parameter range), so epsilon-identical solutions share their
+ * results; a record is returned only if its quantized parameters are equal.
+ * Lookups are lock-free (atomic slots and pread on the file); insertions
+ * append one record with a single write and then publish the slot. When the
+ * index is half full, the writer copies it into a table twice as large and
+ * publishes the new table (the old ones are freed with the cache, since
+ * lookups may still read them).
+ * The file is scanned when opened, so results survive across runs.
+ */
+class hbv_cache
+{
+public:
+
+    hbv_cache(string filename, string forcingFile, string objectives, int nobjs, double resolution, bool storeTraces, bool fastPow);
+    virtual ~hbv_cache();
+
+    /**
+     * key of a parameter vector
+     */
+    hbv_cache_key makeKey(const double *vars);
+
+    /**
+     * objectives of a stored parameter set (false if not found)
+     */
+    bool lookup(const hbv_cache_key &key, double *objs);
+
+    /**
+     * simulated flows of a stored parameter set (false if not stored)
+     */
+    bool lookupTrace(const hbv_cache_key &key, vector<double> &trace);
+
+    /**
+     * store the results of a parameter set (trace can be NULL)
+     */
+    void insert(const hbv_cache_key &key, const double *objs, const double *trace, int traceLength);
+
+    bool storesTraces();
+    long getHits();
+    long getMisses();
+    long getSize();
+
+protected:
+
+    struct record_header
+    {
+        uint32_t magic;         // record marker
+        uint32_t size;          // bytes of the whole record
+        uint64_t key;
+        int32_t nobjs;
+        int32_t traceBytes;     // bytes of the compressed trace (0 = none)
+        int32_t traceLength;    // number of values of the trace
+        int32_t nvars;          // quantized parameters (0 = older format)
+    };
+
+    // index: key and offset of the record (key 0 = empty slot)
+    struct index_table
+    {
+        uint64_t capacity;
+        atomic<uint64_t> *slotKeys;
+        atomic<int64_t> *slotOffsets;
+    };
+
+    void load();
+    bool readHeader(int64_t offset, record_header &h);
+    bool readRecord(const hbv_cache_key &key, int64_t &offset, record_header &h, double *objs);
+    index_table *newTable(uint64_t capacity);
+    void publish(uint64_t key, int64_t offset);
+    int64_t find(uint64_t key);
+
+    static uint64_t hashBytes(uint64_t h, const void *data, size_t n);
+    static uint64_t hashFile(string filename);
+
+    int fd;
+    string filename;
+    int nobjs;
+    double resolution;
+    bool storeTraces;
+    uint64_t baseKey;           // format, forcing data, objectives and settings
+
+    atomic<index_table*> index; // current table
+    vector<index_table*> tables; // all the tables, freed with the cache
+    atomic<long> nEntries;
+
+    atomic<long> hits;
+    atomic<long> misses;
+    mutex writeMutex;           // insertions and growth of the index
+
+};
+}
+
+#endif // HBV_CACHE_H
@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "hbv_fastmath.h"
+#include "hbv_model.h"
+#include <math.h>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <chrono>
+
+using namespace std;
+
+/**
+ * Checks run by make check (not part of SimHBV):
+ *  - hbv_pow against pow over the range of the soil moisture term
+ *    (SM/FC)^BETA and at its edges (documented bound in hbv_fastmath.h)
+ *  - hooks of hbv_model::calc_HBV: a no-op hook (lambda passed as a
+ *    temporary) gives the flows of the run without hook, in the same time,
+ *    and a withdrawal from the soil (function object) reduces them
+ */
+
+bool checkFastPow()
+{
+    // relative error over 1e-12 <= x <= 1 (log-spaced) and 0 <= y <= 7
+    double maxErr = 0.0, xMax = 0.0, yMax = 0.0;
+    for(int i=0; i<=12000; i++){
+        double x = pow(10.0, -12.0*i/12000);
+        for(int j=0; j<=700; j++){
+            double y = 0.01*j;
+            double exact = pow(x, y);
+            double err = fabs(hbv_pow(x, y) - exact)/exact;
+            if(err > maxErr){
+                maxErr = err;
+                xMax = x;
+                yMax = y;
+            }
+        }
+    }
+    bool ok = maxErr < 2.0e-13;
+    cout << "hbv_pow: maximum relative error " << maxErr << " (x = " << xMax << ", y = " << yMax
+         << "), bound 2e-13: " << (ok ? "ok" : "FAILED") << endl;
+
+    // edges: empty soil (x = 0) and BETA = 0, as pow
+    double xs[] = {0.0, 1.0e-300, 0.5, 1.0};
+    double ys[] = {0.0, 1.0e-3, 1.0, 7.0};
+    for(int i=0; i<4; i++){
+        for(int j=0; j<4; j++){
+            double exact = pow(xs[i], ys[j]);
+            double fast = hbv_pow(xs[i], ys[j]);
+            if(fabs(fast - exact) > 2.0e-13*exact){
+                cout << "hbv_pow(" << xs[i] << ", " << ys[j] << ") = " << fast << " instead of " << exact << ": FAILED" << endl;
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+
+// example of coupling: constant withdrawal from the soil moisture (irrigation)
+struct withdrawal
+{
+    double demand;
+    double total;
+    void operator()(hbv_step &s)
+    {
+        for(int z=0; z<s.nZones; z++){
+            double w = min(s.sowat[z], demand);
+            s.sowat[z] -= w;
+            total += s.zoneArea[z]*w;
+        }
+    }
+};
+
+bool checkHooks(string dataFile)
+{
+    hbv_model model(dataFile);
+    int nDays = model.getData().nDays;
+    double params[hbv_model::nParams];
+    for(int i=0; i<hbv_model::nParams; i++) params[i] = 0.5*(hbv_model::paramMin[i] + hbv_model::paramMax[i]);
+
+    model.calc_HBV(params);
+    vector<double> Q(model.getFluxes().Qsim, model.getFluxes().Qsim + nDays);
+    model.calc_HBV(params, [](hbv_step &){ });
+    bool ok = true;
+    for(int t=1; t<nDays; t++) ok = ok && model.getFluxes().Qsim[t] == Q[t];
+    cout << "no-op hook: flows " << (ok ? "identical: ok" : "different: FAILED") << endl;
+
+    // best of a few repetitions of each run
+    const int nRuns = 200;
+    double best[2] = {HUGE_VAL, HUGE_VAL};
+    for(int rep=0; rep<5; rep++){
+        for(int k=0; k<2; k++){
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            for(int r=0; r<nRuns; r++){
+                if(k == 0) model.calc_HBV(params);
+                else model.calc_HBV(params, [](hbv_step &){ });
+            }
+            chrono::duration<double> dt = chrono::steady_clock::now() - t0;
+            best[k] = min(best[k], dt.count()/nRuns);
+        }
+    }
+    cout << "no-op hook: " << 1.0e3*best[1] << " ms per run, without hook " << 1.0e3*best[0] << " ms" << endl;
+
+    withdrawal w = {0.1, 0.0};
+    model.calc_HBV(params, w);
+    double volume = 0.0, volume0 = 0.0;
+    for(int t=1; t<nDays; t++){
+        volume += model.getFluxes().Qsim[t];
+        volume0 += Q[t];
+    }
+    bool reduced = w.total > 0.0 && volume < volume0;
+    cout << "withdrawal hook: " << w.total << " mm withdrawn, flow volume " << volume << " mm instead of "
+         << volume0 << " mm: " << (reduced ? "ok" : "FAILED") << endl;
+    model.hbv_delete(nDays);
+    return ok && reduced;
+}
+
+
+int main(int argc, char **argv)
+{
+    string dataFile = argc > 1 ? argv[1] : "example_data/data_Tavg.txt";
+    bool ok = checkFastPow();
+    ok = checkHooks(dataFile) && ok;
+    return ok ? 0 : 1;
+}
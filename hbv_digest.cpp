@@ -0,0 +1,154 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_digest.h"
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+hbv_digest::hbv_digest(double compression)
+{
+    this->compression = compression;
+    total = 0.0;
+    minValue = numeric_limits<double>::infinity();
+    maxValue = -numeric_limits<double>::infinity();
+}
+
+void hbv_digest::add(double x, double w)
+{
+    if(!(w > 0.0) || x != x) return;
+    bufMean.push_back(x);
+    bufWeight.push_back(w);
+    if(x < minValue) minValue = x;
+    if(x > maxValue) maxValue = x;
+    if(bufMean.size() >= (size_t)ceil(compression)) compress();
+}
+
+void hbv_digest::merge(const hbv_digest &other)
+{
+    mean.insert(mean.end(), other.mean.begin(), other.mean.end());
+    weight.insert(weight.end(), other.weight.begin(), other.weight.end());
+    mean.insert(mean.end(), other.bufMean.begin(), other.bufMean.end());
+    weight.insert(weight.end(), other.bufWeight.begin(), other.bufWeight.end());
+    if(other.minValue < minValue) minValue = other.minValue;
+    if(other.maxValue > maxValue) maxValue = other.maxValue;
+    compress();
+}
+
+double hbv_digest::totalWeight() const
+{
+    double w = total;
+    for(unsigned int i=0; i<bufWeight.size(); i++) w += bufWeight[i];
+    return w;
+}
+
+int hbv_digest::centroids()
+{
+    compress();
+    return mean.size();
+}
+
+void hbv_digest::pack(vector<double> &buf)
+{
+    compress();
+    buf.push_back(mean.size());
+    buf.push_back(minValue);
+    buf.push_back(maxValue);
+    buf.insert(buf.end(), mean.begin(), mean.end());
+    buf.insert(buf.end(), weight.begin(), weight.end());
+}
+
+size_t hbv_digest::unpack(const double *buf)
+{
+    int n = (int)buf[0];
+    mean.insert(mean.end(), buf+3, buf+3+n);
+    weight.insert(weight.end(), buf+3+n, buf+3+2*n);
+    if(buf[1] < minValue) minValue = buf[1];
+    if(buf[2] > maxValue) maxValue = buf[2];
+    compress();
+    return 3 + 2*n;
+}
+
+void hbv_digest::compress()
+{
+    // centroids and buffered values, sorted by mean
+    mean.insert(mean.end(), bufMean.begin(), bufMean.end());
+    weight.insert(weight.end(), bufWeight.begin(), bufWeight.end());
+    bufMean.clear();
+    bufWeight.clear();
+    int n = mean.size();
+    if(n == 0) return;
+    vector<int> order(n);
+    for(int i=0; i<n; i++) order[i] = i;
+    sort(order.begin(), order.end(), [this](int a, int b){ return mean[a] < mean[b]; });
+
+    total = 0.0;
+    for(int i=0; i<n; i++) total += weight[i];
+
+    // greedy merge: a centroid grows while the scale function k1(q) =
+    // compression/(2 pi) asin(2q-1) increases by at most one across it
+    vector<double> m, w;
+    m.reserve(n);
+    w.reserve(n);
+    double cum = 0.0;
+    double kLimit = 0.0;
+    for(int k=0; k<n; k++){
+        int i = order[k];
+        double q = (cum + weight[i])/total;
+        if(!m.empty() && q <= kLimit){
+            w.back() += weight[i];
+            m.back() += (mean[i] - m.back())*weight[i]/w.back();
+        }else{
+            m.push_back(mean[i]);
+            w.push_back(weight[i]);
+            // largest quantile allowed for the new centroid
+            double k1 = compression/(2.0*M_PI)*asin(2.0*cum/total - 1.0) + 1.0;
+            kLimit = k1 >= compression/4.0 ? 1.0 : 0.5*(sin(k1*2.0*M_PI/compression) + 1.0);
+        }
+        cum += weight[i];
+    }
+    mean.swap(m);
+    weight.swap(w);
+}
+
+double hbv_digest::quantile(double q)
+{
+    compress();
+    int n = mean.size();
+    if(n == 0) return numeric_limits<double>::quiet_NaN();
+    if(n == 1) return mean[0];
+
+    // piecewise linear interpolation between the centroid centres, each
+    // centroid covering its weight around its mean (half on each side), and
+    // towards the extreme values in the tails
+    double target = q*total;
+    if(target <= weight[0]/2.0){
+        return minValue + (mean[0] - minValue)*target/(weight[0]/2.0);
+    }
+    double cum = weight[0]/2.0;
+    for(int i=0; i<n-1; i++){
+        double dw = (weight[i] + weight[i+1])/2.0;
+        if(target <= cum + dw){
+            return mean[i] + (mean[i+1] - mean[i])*(target - cum)/dw;
+        }
+        cum += dw;
+    }
+    return mean[n-1] + (maxValue - mean[n-1])*min(1.0, (target - cum)/(weight[n-1]/2.0));
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_DIGEST_H
+#define HBV_DIGEST_H
+
+#include <vector>
+
+namespace std{
+
+/**
+ * Weighted t-digest (Dunning and Ertl, 2019, merging variant): streaming
+ * sketch of a distribution as a sorted list of centroids (mean, weight),
+ * small in the tails and large in the middle (scale function k1), so that
+ * the extreme quantiles are the most accurate. The values are buffered and
+ * merged into the centroids when the buffer is full; the number of
+ * centroids stays below about the compression, whatever the number of
+ * values. Two digests are merged by merging their centroids, so partial
+ * digests (e.g. one per thread) can be combined at the end.
+ */
+class hbv_digest
+{
+public:
+
+    hbv_digest(double compression = 100.0);
+
+    void add(double x, double w = 1.0);
+
+    /**
+     * add the values of another digest
+     */
+    void merge(const hbv_digest &other);
+
+    /**
+     * weighted quantile q (0 <= q <= 1) of the values added (NaN if none)
+     */
+    double quantile(double q);
+
+    double totalWeight() const;
+    int centroids();
+
+    /**
+     * append the digest to a buffer (number of centroids, extreme values,
+     * means and weights), and merge a digest packed at buf (returns the
+     * number of doubles read)
+     */
+    void pack(vector<double> &buf);
+    size_t unpack(const double *buf);
+
+protected:
+
+    void compress();
+
+    double compression;
+    vector<double> mean;    // centroids, sorted by mean
+    vector<double> weight;
+    vector<double> bufMean; // values not merged yet
+    vector<double> bufWeight;
+    double total;
+    double minValue, maxValue;
+
+};
+}
+
+#endif // HBV_DIGEST_H
@@ -0,0 +1,298 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_dream.h"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+
+using namespace std;
+
+hbv_dream::hbv_dream(int nvars, const double *lb, const double *ub, dream_settings &settings)
+{
+    this->nvars = nvars;
+    this->lb.assign(lb, lb+nvars);
+    this->ub.assign(ub, ub+nvars);
+    this->settings = settings;
+    rng.seed(settings.seed);
+
+    // at least 2*nDelta+1 chains are needed by the proposals
+    nChains = max(settings.nChains, 2*settings.nDelta + 1);
+    generation = 0;
+    int maxGenerations = max(settings.maxNFE / nChains - 1, 1);
+    burnInGenerations = int(settings.burnIn*maxGenerations);
+
+    pCR.assign(settings.nCR, 1.0/settings.nCR);
+    jumpCR.assign(settings.nCR, 0.0);
+    countCR.assign(settings.nCR, 0.0);
+    history.resize(nChains);
+
+    nSamples = 0;
+    mean.assign(nChains*nvars, 0.0);
+    m2.assign(nChains*nvars, 0.0);
+    proposals = 0;
+    accepted = 0;
+    posterior = NULL;
+}
+
+hbv_dream::~hbv_dream()
+{
+    delete posterior;
+}
+
+
+void hbv_dream::run(hbv_evaluator &evaluator)
+{
+    if(!settings.posteriorFile.empty()){
+        posterior = new ofstream(settings.posteriorFile.c_str(), ios::out | ios::binary);
+    }
+
+    // initial population: uniform prior
+    uniform_real_distribution<double> U(0.0, 1.0);
+    x.resize(nChains*nvars);
+    for(int i=0; i<nChains; i++){
+        for(int j=0; j<nvars; j++) x[i*nvars+j] = lb[j] + U(rng)*(ub[j]-lb[j]);
+    }
+    vector<double> objs(nChains);
+    evaluator.evaluate(nChains, &x[0], &objs[0]);
+    logL.resize(nChains);
+    for(int i=0; i<nChains; i++){
+        logL[i] = objs[i] == objs[i] ? -objs[i] : -numeric_limits<double>::max();
+    }
+    int nfe = nChains;
+
+    vector<double> proposal(nChains*nvars);
+    vector<int> crIndex(nChains);
+    vector<bool> acceptedNow(nChains);
+    while(nfe + nChains <= settings.maxNFE){
+        propose(proposal, crIndex);
+        evaluator.evaluate(nChains, &proposal[0], &objs[0]);
+        nfe += nChains;
+
+        // Metropolis acceptance (uniform prior, symmetric proposal)
+        vector<double> previous(x);
+        for(int i=0; i<nChains; i++){
+            double logLnew = objs[i] == objs[i] ? -objs[i] : -numeric_limits<double>::max();
+            acceptedNow[i] = logLnew >= logL[i] || log(U(rng)) < logLnew - logL[i];
+            if(acceptedNow[i]){
+                copy(&proposal[i*nvars], &proposal[(i+1)*nvars], &x[i*nvars]);
+                logL[i] = logLnew;
+                accepted++;
+            }
+            proposals++;
+        }
+        generation++;
+
+        if(generation <= burnInGenerations){
+            adaptCrossover(previous, crIndex, acceptedNow);
+            for(int i=0; i<nChains; i++) history[i].push_back(logL[i]);
+            removeOutliers();
+        }else{
+            updateStatistics();
+            if(posterior != NULL && (generation - burnInGenerations) % settings.thin == 0) saveSamples();
+        }
+
+        if(settings.reportFreq > 0 && generation % settings.reportFreq == 0 && nSamples > 1){
+            vector<double> rhat = getRhat();
+            cerr << "dream: generation " << generation << ", " << nfe << " evaluations, max R-hat "
+                 << *max_element(rhat.begin(), rhat.end()) << endl;
+        }
+    }
+
+    if(posterior != NULL) posterior->close();
+}
+
+
+void hbv_dream::propose(vector<double> &proposal, vector<int> &crIndex)
+{
+    uniform_real_distribution<double> U(0.0, 1.0);
+    normal_distribution<double> N(0.0, 1.0);
+    uniform_int_distribution<int> pickDelta(1, settings.nDelta);
+    discrete_distribution<int> pickCR(pCR.begin(), pCR.end());
+
+    for(int i=0; i<nChains; i++){
+        // chain pairs for the differential evolution (distinct, excluding i)
+        int delta = pickDelta(rng);
+        vector<int> others;
+        for(int k=0; k<nChains; k++) if(k != i) others.push_back(k);
+        shuffle(others.begin(), others.end(), rng);
+
+        // subspace sampling: each parameter is updated with probability CR
+        crIndex[i] = pickCR(rng);
+        double CR = double(crIndex[i] + 1)/settings.nCR;
+        vector<int> dims;
+        for(int j=0; j<nvars; j++) if(U(rng) < CR) dims.push_back(j);
+        if(dims.empty()) dims.push_back(uniform_int_distribution<int>(0, nvars-1)(rng));
+
+        // jump rate, with a unit jump every 5 generations on average (mode jumping)
+        double gamma = U(rng) < 0.2 ? 1.0 : 2.38/sqrt(2.0*delta*dims.size());
+
+        double *xp = &proposal[i*nvars];
+        copy(&x[i*nvars], &x[(i+1)*nvars], xp);
+        for(unsigned int k=0; k<dims.size(); k++){
+            int j = dims[k];
+            double diff = 0.0;
+            for(int d=0; d<delta; d++) diff += x[others[2*d]*nvars+j] - x[others[2*d+1]*nvars+j];
+            double e = 0.1*(2.0*U(rng) - 1.0);
+            xp[j] += (1.0 + e)*gamma*diff + 1.0e-6*(ub[j]-lb[j])*N(rng);
+        }
+        fold(xp);
+    }
+}
+
+
+void hbv_dream::fold(double *xp)
+{
+    // the parameter space is folded into a torus, which keeps the proposal symmetric
+    for(int j=0; j<nvars; j++){
+        double range = ub[j] - lb[j];
+        double v = fmod(xp[j] - lb[j], range);
+        if(v < 0.0) v += range;
+        xp[j] = lb[j] + v;
+    }
+}
+
+
+void hbv_dream::adaptCrossover(const vector<double> &previous, const vector<int> &crIndex, const vector<bool> &accepted)
+{
+    // standard deviation of each parameter among the chains
+    vector<double> sd(nvars);
+    for(int j=0; j<nvars; j++){
+        double m = 0.0, s = 0.0;
+        for(int i=0; i<nChains; i++) m += x[i*nvars+j];
+        m /= nChains;
+        for(int i=0; i<nChains; i++) s += (x[i*nvars+j] - m)*(x[i*nvars+j] - m);
+        sd[j] = max(sqrt(s/(nChains-1)), 1.0e-12);
+    }
+
+    // crossover values are selected in proportion to their normalized squared jump distance
+    for(int i=0; i<nChains; i++){
+        double jump = 0.0;
+        if(accepted[i]){
+            for(int j=0; j<nvars; j++){
+                double d = (x[i*nvars+j] - previous[i*nvars+j])/sd[j];
+                jump += d*d;
+            }
+        }
+        jumpCR[crIndex[i]] += jump;
+        countCR[crIndex[i]] += 1.0;
+    }
+    double total = 0.0;
+    for(int m=0; m<settings.nCR; m++){
+        if(countCR[m] > 0.0) total += jumpCR[m]/countCR[m];
+    }
+    if(total <= 0.0) return;
+    for(int m=0; m<settings.nCR; m++){
+        pCR[m] = countCR[m] > 0.0 ? max(jumpCR[m]/countCR[m]/total, 1.0e-3) : 1.0/settings.nCR;
+    }
+}
+
+
+void hbv_dream::removeOutliers()
+{
+    // mean log-likelihood of the last half of each chain (interquartile range rule)
+    int len = history[0].size();
+    if(len < 10) return;
+    vector<double> omega(nChains);
+    for(int i=0; i<nChains; i++){
+        double s = 0.0;
+        for(int t=len/2; t<len; t++) s += history[i][t];
+        omega[i] = s/(len - len/2);
+    }
+    vector<double> sorted(omega);
+    sort(sorted.begin(), sorted.end());
+    double q1 = sorted[nChains/4];
+    double q3 = sorted[(3*nChains)/4];
+    int best = max_element(logL.begin(), logL.end()) - logL.begin();
+    for(int i=0; i<nChains; i++){
+        if(omega[i] < q1 - 2.0*(q3 - q1)){
+            copy(&x[best*nvars], &x[(best+1)*nvars], &x[i*nvars]);
+            logL[i] = logL[best];
+            history[i] = history[best];
+        }
+    }
+}
+
+
+void hbv_dream::updateStatistics()
+{
+    // running mean and variance of each chain (Welford)
+    nSamples++;
+    for(int k=0; k<nChains*nvars; k++){
+        double d = x[k] - mean[k];
+        mean[k] += d/nSamples;
+        m2[k] += d*(x[k] - mean[k]);
+    }
+}
+
+
+vector<double> hbv_dream::getRhat()
+{
+    vector<double> rhat(nvars, numeric_limits<double>::infinity());
+    if(nSamples < 2) return rhat;
+    double n = nSamples;
+    for(int j=0; j<nvars; j++){
+        double grand = 0.0, W = 0.0, B = 0.0;
+        for(int i=0; i<nChains; i++){
+            grand += mean[i*nvars+j];
+            W += m2[i*nvars+j]/(n-1);
+        }
+        grand /= nChains;
+        W /= nChains;
+        for(int i=0; i<nChains; i++) B += (mean[i*nvars+j] - grand)*(mean[i*nvars+j] - grand);
+        B *= n/(nChains-1);
+        double var = (n-1)/n*W + B/n;
+        rhat[j] = W > 0.0 ? sqrt(var/W) : 1.0;
+    }
+    return rhat;
+}
+
+
+void hbv_dream::saveSamples()
+{
+    vector<double> row(nvars+1);
+    for(int i=0; i<nChains; i++){
+        copy(&x[i*nvars], &x[(i+1)*nvars], row.begin());
+        row[nvars] = logL[i];
+        posterior->write((const char*)&row[0], row.size()*sizeof(double));
+    }
+}
+
+
+void hbv_dream::printSummary(ostream &out)
+{
+    vector<double> rhat = getRhat();
+    out << setprecision(6);
+    out << "# " << nChains << " chains, " << generation << " generations (" << burnInGenerations << " burn-in), acceptance rate "
+        << (proposals > 0 ? 100.0*accepted/proposals : 0.0) << "%" << endl;
+    out << "# parameter mean sd R-hat" << endl;
+    for(int j=0; j<nvars; j++){
+        double m = 0.0, v = 0.0;
+        for(int i=0; i<nChains; i++) m += mean[i*nvars+j];
+        m /= nChains;
+        // total variance: within-chain plus between-chain
+        for(int i=0; i<nChains; i++){
+            v += (nSamples > 1 ? m2[i*nvars+j]/(nSamples-1) : 0.0) + (mean[i*nvars+j] - m)*(mean[i*nvars+j] - m);
+        }
+        v /= nChains;
+        out << j << " " << m << " " << sqrt(v) << " " << rhat[j] << endl;
+    }
+}
@@ -0,0 +1,116 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_DREAM_H
+#define HBV_DREAM_H
+
+#include "hbv_pool.h"
+#include <vector>
+#include <string>
+#include <random>
+#include <ostream>
+#include <fstream>
+
+namespace std{
+
+struct dream_settings
+{
+    int nChains;            // number of chains
+    int maxNFE;             // number of likelihood evaluations
+    double burnIn;          // fraction of the generations discarded (and used to adapt the sampler)
+    int thin;               // generations between two saved samples
+    int nCR;                // number of crossover probabilities
+    int nDelta;             // maximum number of chain pairs of a proposal
+    unsigned int seed;      // random seed
+    string posteriorFile;   // binary file of the posterior samples (empty = none)
+    int reportFreq;         // generations between two convergence reports (0 = none)
+};
+
+/**
+ * DREAM (DiffeRential Evolution Adaptive Metropolis, Vrugt et al., 2009)
+ * sampler of the posterior distribution of the parameters, with a uniform
+ * prior within the bounds. The objective returned by the evaluator is the
+ * negative log-likelihood. The proposals of all the chains of a generation
+ * are evaluated as one batch (i.e. in parallel by the pool). During the
+ * burn-in the crossover probabilities are adapted and the outlier chains are
+ * moved to the best one; afterwards the Gelman-Rubin R-hat of each
+ * parameter is updated at every generation (running means and variances of
+ * each chain, no history), and every thin generations the states of all the
+ * chains are appended to the posterior file, as rows of nvars+1 doubles
+ * (parameters and log-likelihood, native byte order).
+ */
+class hbv_dream
+{
+public:
+
+    hbv_dream(int nvars, const double *lb, const double *ub, dream_settings &settings);
+    virtual ~hbv_dream();
+
+    void run(hbv_evaluator &evaluator);
+
+    /**
+     * Gelman-Rubin statistic of each parameter (samples after the burn-in)
+     */
+    vector<double> getRhat();
+
+    /**
+     * acceptance rate, R-hat and posterior mean and standard deviation
+     */
+    void printSummary(ostream &out);
+
+protected:
+
+    void propose(vector<double> &proposals, vector<int> &crIndex);
+    void fold(double *x);
+    void adaptCrossover(const vector<double> &previous, const vector<int> &crIndex, const vector<bool> &accepted);
+    void removeOutliers();
+    void updateStatistics();
+    void saveSamples();
+
+    int nvars;
+    vector<double> lb;
+    vector<double> ub;
+    dream_settings settings;
+    mt19937 rng;
+
+    int nChains;
+    int generation;
+    int burnInGenerations;
+    vector<double> x;           // current state of the chains [chain][var]
+    vector<double> logL;        // current log-likelihood of the chains
+    vector<vector<double> > history; // log-likelihood of each chain, by generation (burn-in)
+
+    // crossover
+    vector<double> pCR;         // probabilities of the crossover values m/nCR
+    vector<double> jumpCR;      // normalized squared jumps of each crossover value
+    vector<double> countCR;     // number of proposals of each crossover value
+
+    // running statistics of the chains after the burn-in [chain][var]
+    long nSamples;
+    vector<double> mean;
+    vector<double> m2;
+
+    long proposals;
+    long accepted;
+    ofstream *posterior;
+
+};
+}
+
+#endif // HBV_DREAM_H
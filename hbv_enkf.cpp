@@ -0,0 +1,238 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_enkf.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+hbv_enkf::hbv_enkf(hbv_model *model, int nMembers, double obsError, double precipError, unsigned int seed)
+{
+    this->model = model;
+    this->nMembers = max(nMembers, 2);
+    this->obsError = obsError;
+    this->precipError = precipError;
+    rng.seed(seed);
+    bands = NULL;
+    nZones = model->data.nZones;
+    nDays = model->data.nDays;
+
+    int N = this->nMembers;
+    sowat.resize(nZones*N);
+    sdep.resize(nZones*N);
+    stw1.resize(N);
+    stw2.resize(N);
+    Q.resize(N);
+    pf.resize(N);
+    runoff.resize(N);
+    Qall.resize(N);
+    anomaly.resize(N);
+    innovation.resize(N);
+    forecast.resize(nDays);
+    analyzed.resize(nDays);
+    spread.resize(nDays);
+}
+
+hbv_enkf::~hbv_enkf()
+{
+}
+
+const double *hbv_enkf::getForecast()
+{
+    return &forecast[0];
+}
+
+const double *hbv_enkf::getAnalysis()
+{
+    return &analyzed[0];
+}
+
+const double *hbv_enkf::getSpread()
+{
+    return &spread[0];
+}
+
+void hbv_enkf::setBands(hbv_bands *bands)
+{
+    this->bands = bands;
+}
+
+
+void hbv_enkf::run(double *parameters)
+{
+    // parameters and routing weights of the model
+    model->start(parameters);
+    fill(sowat.begin(), sowat.end(), 0.0);
+    fill(sdep.begin(), sdep.end(), 0.0);
+    fill(stw1.begin(), stw1.end(), 0.0);
+    fill(stw2.begin(), stw2.end(), 0.0);
+    Qrouting.assign(2*model->params.maxbas*nMembers, 0.0);
+    routingHead = 0;
+    forecast[0] = analyzed[0] = spread[0] = 0.0;
+
+    for(int day=1; day<nDays; day++){
+        step(day);
+
+        // ensemble mean and spread of the forecast
+        double mean = 0.0, var = 0.0;
+        #pragma omp simd reduction(+:mean)
+        for(int m=0; m<nMembers; m++) mean += Q[m];
+        mean /= nMembers;
+        #pragma omp simd reduction(+:var)
+        for(int m=0; m<nMembers; m++) var += (Q[m] - mean)*(Q[m] - mean);
+        forecast[day] = mean;
+        spread[day] = sqrt(var/(nMembers-1));
+        if(bands != NULL) bands->add(0, day, &Q[0], nMembers);
+
+        double obs = model->data.flow[day];
+        if(obs >= 0.0) analysis(obs);
+
+        mean = 0.0;
+        #pragma omp simd reduction(+:mean)
+        for(int m=0; m<nMembers; m++) mean += Q[m];
+        analyzed[day] = mean/nMembers;
+    }
+}
+
+
+void hbv_enkf::step(int day)
+{
+    // same processes as hbv_model::run, for all the members at once
+    if(model->fastPow) members<true>(day);
+    else members<false>(day);
+}
+
+
+template<bool fast> void hbv_enkf::members(int day)
+{
+    int N = nMembers;
+    hbv_parameters &p = model->params;
+    MyData &data = model->data;
+    double temp, precip;
+    model->forcing(model->startingIndex + day, precip, temp);
+
+    // perturbed precipitation (multiplier with mean 1)
+    normal_distribution<double> normal(0.0, 1.0);
+    for(int m=0; m<N; m++){
+        pf[m] = precipError > 0.0 ? exp(precipError*normal(rng) - 0.5*precipError*precipError) : 1.0;
+    }
+    fill(runoff.begin(), runoff.end(), 0.0);
+
+    for(int z=0; z<nZones; z++){
+        double tz = temp + data.zoneDeltaT[z];
+        double PE = model->evap.PE[day*nZones+z];
+        double area = data.zoneArea[z];
+        double *sd = &sdep[z*N];
+        double *sw = &sowat[z*N];
+
+        #pragma omp simd
+        for(int m=0; m<N; m++){
+            double e, r, et;
+            hbv_model::snowZone(tz, precip*pf[m], sd[m], p, sd[m], e);
+            hbv_model::soilZone<fast>(sw[m], e, PE, p, sw[m], r, et);
+            runoff[m] += area*r;
+        }
+    }
+
+    // reservoirs (the lower one starts from zero at each step, as in hbv_model)
+    #pragma omp simd
+    for(int m=0; m<N; m++){
+        double s1 = stw1[m] + runoff[m];
+        double s2 = 0.0;
+        Qall[m] = hbv_model::reservoirs(s1, s2, p);
+        stw1[m] = s1;
+        stw2[m] = s2;
+    }
+
+    // routing
+    int klen = 2*p.maxbas;
+    for(int i=0; i<p.maxbas; i++){
+        int k = (routingHead + i) % klen;
+        double w = model->routingWeights[i];
+        double *q = &Qrouting[k*N];
+        #pragma omp simd
+        for(int m=0; m<N; m++) q[m] += Qall[m]*w;
+    }
+    double *q = &Qrouting[routingHead*N];
+    for(int m=0; m<N; m++){
+        Q[m] = q[m];
+        q[m] = 0.0;
+    }
+    routingHead = (routingHead + 1) % klen;
+}
+
+
+void hbv_enkf::analysis(double obs)
+{
+    int N = nMembers;
+    double fcap = model->params.fcap;
+
+    // innovation of each member with a perturbed observation
+    double sd = max(obsError*obs, 1.0e-3);
+    double R = sd*sd;
+    normal_distribution<double> normal(0.0, sd);
+    double ym = 0.0;
+    for(int m=0; m<N; m++){
+        innovation[m] = obs + normal(rng);
+        ym += Q[m];
+    }
+    ym /= N;
+    double Cyy = 0.0;
+    #pragma omp simd reduction(+:Cyy)
+    for(int m=0; m<N; m++){
+        anomaly[m] = Q[m] - ym;
+        Cyy += anomaly[m]*anomaly[m];
+        innovation[m] -= Q[m];
+    }
+    Cyy /= (N-1);
+    if(Cyy <= 0.0) return;
+
+    // x += C_xy / (C_yy + R) * innovation, for each state variable
+    vector<double*> vars;
+    vector<double> upper;
+    for(int z=0; z<nZones; z++){
+        vars.push_back(&sowat[z*N]);
+        upper.push_back(fcap);
+        vars.push_back(&sdep[z*N]);
+        upper.push_back(HUGE_VAL);
+    }
+    vars.push_back(&stw1[0]);
+    upper.push_back(HUGE_VAL);
+    int klen = 2*model->params.maxbas;
+    for(int i=0; i<model->params.maxbas; i++){
+        vars.push_back(&Qrouting[((routingHead + i) % klen)*N]);
+        upper.push_back(HUGE_VAL);
+    }
+    vars.push_back(&Q[0]);
+    upper.push_back(HUGE_VAL);
+
+    for(unsigned int j=0; j<vars.size(); j++){
+        double *x = vars[j];
+        double xm = 0.0, Cxy = 0.0;
+        #pragma omp simd reduction(+:xm)
+        for(int m=0; m<N; m++) xm += x[m];
+        xm /= N;
+        #pragma omp simd reduction(+:Cxy)
+        for(int m=0; m<N; m++) Cxy += (x[m] - xm)*anomaly[m];
+        double K = Cxy/(N-1)/(Cyy + R);
+        double hi = upper[j];
+        #pragma omp simd
+        for(int m=0; m<N; m++) x[m] = min(max(x[m] + K*innovation[m], 0.0), hi);
+    }
+}
@@ -0,0 +1,103 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_ENKF_H
+#define HBV_ENKF_H
+
+#include "hbv_model.h"
+#include "hbv_bands.h"
+#include <vector>
+#include <random>
+
+namespace std{
+
+/**
+ * Ensemble Kalman filter assimilating the observed streamflow into the
+ * states of the model (soil moisture and snow of each zone, upper
+ * reservoir and routing buffer). The ensemble is driven by multiplicative
+ * lognormal errors of the precipitation, and each observation (negative =
+ * missing) updates the members with perturbed observations (Burgers et al.,
+ * 1998); with a single observed variable the gain is a vector and no matrix
+ * has to be inverted.
+ * The members run the processes of hbv_model (snowZone, soilZone and
+ * reservoirs, with the forcing of hbv_model::forcing) on their own states.
+ * Each state variable is a contiguous array over the members, so that the
+ * model step and the analysis are loops over the members that map to SIMD
+ * lanes.
+ */
+class hbv_enkf
+{
+public:
+
+    hbv_enkf(hbv_model *model, int nMembers, double obsError, double precipError, unsigned int seed);
+    virtual ~hbv_enkf();
+
+    /**
+     * run the filter over the whole record with the parameters of the model
+     */
+    void run(double *parameters);
+
+    /**
+     * ensemble mean of the flow before (forecast) and after (analysis) the
+     * update of each time step, and standard deviation of the forecast
+     */
+    const double *getForecast();
+    const double *getAnalysis();
+    const double *getSpread();
+
+    /**
+     * the forecast flows of all the members are added to the bands at each
+     * time step (bands can be NULL)
+     */
+    void setBands(hbv_bands *bands);
+
+protected:
+
+    void step(int day);
+    template<bool fast> void members(int day);
+    void analysis(double obs);
+
+    hbv_model *model;
+    int nMembers;
+    int nZones;
+    int nDays;
+    double obsError;        // standard deviation of the flow observations (relative)
+    double precipError;     // standard deviation of the log of the precipitation multiplier
+    mt19937 rng;
+
+    // ensemble states [variable][member]
+    vector<double> sowat;   // [nZones][nMembers]
+    vector<double> sdep;    // [nZones][nMembers]
+    vector<double> stw1;
+    vector<double> stw2;
+    vector<double> Qrouting; // [2*maxbas][nMembers], circular over the first index
+    int routingHead;
+    vector<double> Q;       // routed flow of the time step
+
+    // work arrays [nMembers]
+    vector<double> pf, runoff, Qall, anomaly, innovation;
+
+    // results [nDays]
+    vector<double> forecast, analyzed, spread;
+    hbv_bands *bands;
+
+};
+}
+
+#endif // HBV_ENKF_H
@@ -0,0 +1,294 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "hbv_extremes.h"
+#include "hbv_monitor.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <atomic>
+#include <cmath>
+
+using namespace std;
+
+hbv_extremes::hbv_extremes(string forcingFile, extremes_settings &settings)
+{
+    this->forcingFile = forcingFile;
+    this->settings = settings;
+
+    // synthetic series fitted on the historical forcing, or the data file itself
+    if(settings.years > 0){
+        hbv_model historical(forcingFile);
+        source = new hbv_weather_generator(&historical, settings.years, settings.seed);
+        historical.hbv_delete(historical.getData().nDays);
+    }else{
+        hbv_model header(forcingFile, settings.chunk);
+        source = new hbv_forcing_reader(forcingFile, &header);
+        header.hbv_delete(header.getData().nDays);
+    }
+
+    if(!settings.eventsFile.empty()){
+        events.open(settings.eventsFile.c_str(), ios::out);
+        if(!events){
+            cout << "The events file " << settings.eventsFile << " could not be created" << endl;
+            exit(1);
+        }
+        events << "# run type year month day hour Q" << endl << setprecision(10);
+    }
+}
+
+hbv_extremes::~hbv_extremes()
+{
+    delete source;
+    if(events.is_open()) events.close();
+}
+
+
+void hbv_extremes::run(int nSets, const double *vars, int nThreads)
+{
+    fits.assign(nSets, extremes_fit());
+    int n = nThreads > 0 ? nThreads : max((int)thread::hardware_concurrency(), 1);
+    n = max(min(n, nSets), 1);
+
+    // each thread streams its own copy of the forcing through its own model
+    atomic<int> next(0);
+    auto worker = [this, nSets, vars, &next](){
+        hbv_model model(forcingFile, settings.chunk);
+        hbv_forcing_source *forcing = source->clone();
+        for(int i = next++; i < nSets; i = next++){
+            simulate(model, *forcing, &vars[i*hbv_model::nParams], i);
+        }
+        delete forcing;
+        model.hbv_delete(model.getData().nDays);
+    };
+    vector<thread> threads;
+    for(int t=1; t<n; t++) threads.push_back(thread(worker));
+    worker();
+    for(unsigned int t=0; t<threads.size(); t++) threads[t].join();
+}
+
+
+void hbv_extremes::simulate(hbv_model &model, hbv_forcing_source &forcing, const double *vars, int run)
+{
+    double stepsPerDay = 24*3600.0/model.getTimeStep();
+    long warmup = model.getWarmup();
+    double years = max(forcing.size() - warmup, 0L)/(365.25*stepsPerDay);
+    long minSteps = ROUNDINT(334*stepsPerDay);
+
+    // annual maxima of the calendar years
+    vector<extreme_event> maxima;
+    extreme_event yearMax;
+    yearMax.Q = -1.0;
+    int year = 0;
+    long yearSteps = 0;
+
+    // largest peaks (min-heap), the smallest one being the threshold of the others
+    size_t nPeaks = max((long)ceil(settings.potRate*years), 1L) + 1;
+    priority_queue<extreme_event, vector<extreme_event>, greater<extreme_event> > peaks;
+    int r = max(ROUNDINT(settings.separation*stepsPerDay), 1);
+    int width = 2*r + 1;
+    vector<extreme_event> window(width);
+    long nWindow = 0;
+
+    hbv_snapshot state;
+    long step = 0; // time step of the first element of the chunk
+    forcing.rewind();
+    model.start((double*)vars);
+    chrono::steady_clock::time_point t0 = hbv_stats::start();
+    int n = model.loadForcing(forcing, false);
+    while(n > 0){
+        model.run(1, n+1);
+        const double *Q = model.getFluxes().Qsim;
+        int **date = model.getData().date;
+
+        for(int i=max(warmup - step, 1L); i<=n; i++){
+            double q = Q[i];
+            const int *d = date[i];
+            if(d[0] != year){
+                if(yearSteps >= minSteps) maxima.push_back(yearMax);
+                year = d[0];
+                yearSteps = 0;
+                yearMax.Q = -1.0;
+            }
+            yearSteps++;
+            if(q > yearMax.Q){
+                yearMax.Q = q;
+                copy(d, d+4, yearMax.date);
+            }
+
+            // the center of the window is a peak if it is its largest flow
+            // (the first one in case of ties)
+            extreme_event &e = window[nWindow % width];
+            e.Q = q;
+            copy(d, d+4, e.date);
+            nWindow++;
+            if(nWindow < width) continue;
+            const extreme_event &c = window[(nWindow - 1 - r) % width];
+            if(c.Q <= 0.0 || (peaks.size() == nPeaks && c.Q <= peaks.top().Q)) continue;
+            bool peak = true;
+            for(int j=1; j<=r && peak; j++){
+                peak = window[(nWindow - 1 - r - j) % width].Q < c.Q && window[(nWindow - 1 - r + j) % width].Q <= c.Q;
+            }
+            if(!peak) continue;
+            peaks.push(c);
+            if(peaks.size() > nPeaks) peaks.pop();
+        }
+
+        // the next chunk continues from the state of the last time step
+        step += n;
+        model.saveState(state);
+        n = model.loadForcing(forcing, true);
+        state.day = 0;
+        model.loadState(state);
+    }
+    if(yearSteps >= minSteps) maxima.push_back(yearMax);
+    hbv_stats::evaluation(t0, step);
+
+    double threshold = 0.0;
+    if(peaks.size() == nPeaks){
+        threshold = peaks.top().Q;
+        peaks.pop();
+    }
+    vector<extreme_event> pot;
+    while(!peaks.empty()){
+        pot.push_back(peaks.top());
+        peaks.pop();
+    }
+
+    vector<double> x(maxima.size());
+    for(unsigned int i=0; i<maxima.size(); i++) x[i] = maxima[i].Q;
+    fitGEV(x, fits[run]);
+    x.resize(pot.size());
+    for(unsigned int i=0; i<pot.size(); i++) x[i] = pot[i].Q;
+    fitGPD(x, threshold, years, fits[run]);
+
+    if(events.is_open()){
+        sort(pot.begin(), pot.end(), [](const extreme_event &a, const extreme_event &b){
+            return lexicographical_compare(a.date, a.date+4, b.date, b.date+4);
+        });
+        lock_guard<mutex> lock(eventsLock);
+        for(unsigned int i=0; i<maxima.size(); i++){
+            const int *d = maxima[i].date;
+            events << run << " ams " << d[0] << " " << d[1] << " " << d[2] << " " << d[3] << " " << maxima[i].Q << endl;
+        }
+        for(unsigned int i=0; i<pot.size(); i++){
+            const int *d = pot[i].date;
+            events << run << " pot " << d[0] << " " << d[1] << " " << d[2] << " " << d[3] << " " << pot[i].Q << endl;
+        }
+    }
+}
+
+
+void hbv_extremes::fitGEV(vector<double> &x, extremes_fit &fit)
+{
+    int nT = settings.returnPeriods.size();
+    int n = x.size();
+    fit.gev[0] = fit.gev[1] = fit.gev[2] = NAN;
+    fit.gevLevels.assign(nT, NAN);
+    if(n < 3) return;
+
+    // sample L-moments (probability weighted moments of the sorted sample)
+    sort(x.begin(), x.end());
+    double b0 = 0.0, b1 = 0.0, b2 = 0.0;
+    for(int i=0; i<n; i++){
+        b0 += x[i];
+        b1 += x[i]*i/(n - 1.0);
+        b2 += x[i]*i*(i - 1.0)/((n - 1.0)*(n - 2.0));
+    }
+    b0 /= n;
+    b1 /= n;
+    b2 /= n;
+    double l1 = b0, l2 = 2.0*b1 - b0, l3 = 6.0*b2 - 6.0*b1 + b0;
+    if(l2 <= 0.0) return;
+
+    // shape from the L-skewness (Hosking, 1985), Gumbel if k is close to 0
+    double c = 2.0/(3.0 + l3/l2) - log(2.0)/log(3.0);
+    double k = 7.8590*c + 2.9554*c*c;
+    bool gumbel = fabs(k) < 1.0e-6;
+    double g = tgamma(1.0 + k);
+    double alpha = gumbel ? l2/log(2.0) : l2*k/((1.0 - pow(2.0, -k))*g);
+    double xi = gumbel ? l1 - 0.5772156649*alpha : l1 - alpha*(1.0 - g)/k;
+    fit.gev[0] = xi;
+    fit.gev[1] = alpha;
+    fit.gev[2] = k;
+    for(int j=0; j<nT; j++){
+        double T = settings.returnPeriods[j];
+        if(T <= 1.0) continue;
+        double y = -log(1.0 - 1.0/T);
+        fit.gevLevels[j] = gumbel ? xi - alpha*log(y) : xi + alpha*(1.0 - pow(y, k))/k;
+    }
+}
+
+
+void hbv_extremes::fitGPD(vector<double> &x, double threshold, double years, extremes_fit &fit)
+{
+    int nT = settings.returnPeriods.size();
+    int n = x.size();
+    double rate = years > 0.0 ? n/years : 0.0;
+    fit.gpd[0] = threshold;
+    fit.gpd[1] = fit.gpd[2] = NAN;
+    fit.gpd[3] = rate;
+    fit.gpdLevels.assign(nT, NAN);
+    if(n < 2) return;
+
+    // L-moments of the excesses over the threshold
+    sort(x.begin(), x.end());
+    double b0 = 0.0, b1 = 0.0;
+    for(int i=0; i<n; i++){
+        b0 += x[i] - threshold;
+        b1 += (x[i] - threshold)*i/(n - 1.0);
+    }
+    b0 /= n;
+    b1 /= n;
+    double l1 = b0, l2 = 2.0*b1 - b0;
+    if(l2 <= 0.0) return;
+
+    double k = l1/l2 - 2.0;
+    double alpha = (1.0 + k)*l1;
+    bool exponential = fabs(k) < 1.0e-6;
+    fit.gpd[1] = alpha;
+    fit.gpd[2] = k;
+    // T-year level: exceeded by one peak in rate x T on average
+    for(int j=0; j<nT; j++){
+        double m = rate*settings.returnPeriods[j];
+        if(m <= 1.0) continue;
+        fit.gpdLevels[j] = threshold + (exponential ? alpha*log(m) : alpha*(1.0 - pow(m, -k))/k);
+    }
+}
+
+
+void hbv_extremes::print(ostream &out)
+{
+    int nT = settings.returnPeriods.size();
+    out << "# gev_location gev_scale gev_shape";
+    for(int j=0; j<nT; j++) out << " gev_T" << settings.returnPeriods[j];
+    out << " gpd_threshold gpd_scale gpd_shape gpd_rate";
+    for(int j=0; j<nT; j++) out << " gpd_T" << settings.returnPeriods[j];
+    out << endl << setprecision(10);
+    for(unsigned int i=0; i<fits.size(); i++){
+        extremes_fit &f = fits[i];
+        out << f.gev[0] << " " << f.gev[1] << " " << f.gev[2];
+        for(int j=0; j<nT; j++) out << " " << f.gevLevels[j];
+        out << " " << f.gpd[0] << " " << f.gpd[1] << " " << f.gpd[2] << " " << f.gpd[3];
+        for(int j=0; j<nT; j++) out << " " << f.gpdLevels[j];
+        out << endl;
+    }
+}
@@ -0,0 +1,110 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_EXTREMES_H
+#define HBV_EXTREMES_H
+
+#include "hbv_model.h"
+#include "hbv_stream.h"
+#include <vector>
+#include <string>
+#include <fstream>
+#include <mutex>
+#include <ostream>
+
+namespace std{
+
+struct extremes_settings
+{
+    long years;             // years of synthetic forcing (0 = stream the data file)
+    int chunk;              // time steps of forcing in memory
+    double potRate;         // peaks over the threshold per year
+    double separation;      // minimum distance between two peaks (days)
+    vector<double> returnPeriods; // years
+    string eventsFile;      // annual maxima and peaks of each run (empty = none)
+    unsigned int seed;      // random seed of the weather generator
+};
+
+/**
+ * fitted distributions of the extremes of a run: GEV of the annual maxima
+ * and generalized Pareto of the peaks over the threshold, with the shape
+ * parameter k of Hosking (k < 0: heavy tail), and their return levels
+ */
+struct extremes_fit
+{
+    double gev[3];          // location, scale, shape
+    double gpd[4];          // threshold, scale, shape, peaks per year
+    vector<double> gevLevels;
+    vector<double> gpdLevels;
+};
+
+/**
+ * Flood frequency analysis of long series: the forcing is streamed chunk by
+ * chunk from the data file or from a weather generator fitted on it (see
+ * hbv_stream), so that the memory does not depend on the length of the
+ * series. Only the annual maxima (calendar years with at least 11 months
+ * simulated after the warm-up) and the largest independent peaks (local
+ * maxima of the flows within +-separation days) are kept, with their
+ * dates: potRate x years peaks above the threshold, which is the next
+ * largest peak. GEV and GPD are fitted by L-moments at the end of each
+ * run. The parameter sets are simulated in parallel, each thread with its
+ * own model and source of forcing.
+ */
+class hbv_extremes
+{
+public:
+
+    hbv_extremes(string forcingFile, extremes_settings &settings);
+    virtual ~hbv_extremes();
+
+    /**
+     * simulate nSets parameter sets (rows of vars)
+     */
+    void run(int nSets, const double *vars, int nThreads);
+
+    /**
+     * fitted distributions and return levels, one row per parameter set
+     */
+    void print(ostream &out);
+
+protected:
+
+    struct extreme_event
+    {
+        double Q;
+        int date[4];
+        bool operator>(const extreme_event &e) const { return Q > e.Q; }
+    };
+
+    void simulate(hbv_model &model, hbv_forcing_source &source, const double *vars, int run);
+    void fitGEV(vector<double> &x, extremes_fit &fit);
+    void fitGPD(vector<double> &x, double threshold, double years, extremes_fit &fit);
+
+    string forcingFile;
+    extremes_settings settings;
+    hbv_forcing_source *source;     // cloned by each thread
+    vector<extremes_fit> fits;
+
+    mutex eventsLock;
+    ofstream events;
+
+};
+}
+
+#endif // HBV_EXTREMES_H
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_FASTMATH_H
+#define HBV_FASTMATH_H
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Fast power x^y = exp(y*log(x)) for 0 <= x <= 1 and y >= 0 (the soil
+ * moisture term (SM/FC)^BETA), without branches or calls to libm so that
+ * loops over zones or ensemble members are vectorized.
+ * log: x = m*2^e with m in [sqrt(1/2), sqrt(2)), log(m) = 2 atanh(t),
+ * t = (m-1)/(m+1), |t| < 0.1716, series up to t^15 (truncation < 2e-14).
+ * exp: Cody-Waite reduction y = n*log(2) + r, |r| <= log(2)/2, Taylor
+ * series up to r^11 (truncation < 3e-15) and scaling by 2^n on the exponent.
+ * Maximum relative error against std::pow: below 2e-13 for 1e-12 <= x <= 1
+ * and 0 <= y <= 7 (the bounds of BETA), growing slowly with |y*log(x)| down
+ * to the underflow (y*log(x) < -708 gives 0). As pow, x = 0 gives 0 for
+ * y > 0 and any x gives 1 for y = 0 (BETA = 0 and the empty soil at the
+ * start of a run). Checked by make check (hbv_check.cpp).
+ */
+static inline double hbv_pow(double x, double y)
+{
+    // integer <-> double conversions go through the bits of 2^52 + n (no
+    // 64-bit conversion instructions before AVX-512)
+    const double two52 = 4503599627370496.0;
+    const double round = 6755399441055744.0; // 1.5*2^52
+    uint64_t bits, ebits, mbits;
+    double ed, m, f;
+
+    // log(x), with the exponent e relative to the interval [sqrt(1/2), sqrt(2))
+    double xs = x > 1.0e-300 ? x : 1.0e-300;
+    memcpy(&bits, &xs, sizeof(bits));
+    uint64_t k = (bits + 0x00095f619980c433ULL) >> 52;
+    mbits = bits - (k << 52) + (1023ULL << 52);
+    memcpy(&m, &mbits, sizeof(m));
+    ebits = k | 0x4330000000000000ULL;
+    memcpy(&ed, &ebits, sizeof(ed));
+    double e = ed - (two52 + 1023.0);
+    double t = (m - 1.0)/(m + 1.0);
+    double t2 = t*t;
+    double s = 1.0 + t2*(1.0/3 + t2*(1.0/5 + t2*(1.0/7 + t2*(1.0/9 + t2*(1.0/11 + t2*(1.0/13 + t2*(1.0/15)))))));
+    const double ln2hi = 6.93147180369123816490e-01;
+    const double ln2lo = 1.90821492927058770002e-10;
+    double lx = 2.0*t*s + e*ln2hi + e*ln2lo;
+
+    // exp(y*log(x)), underflow to 0 below -708
+    double z = y*lx;
+    z = z > -708.0 ? z : -708.0;
+    double nr = z*1.44269504088896338700 + round;
+    double n = nr - round;
+    double r = (z - n*ln2hi) - n*ln2lo;
+    double p = 1.0 + r*(1.0 + r*(1.0/2 + r*(1.0/6 + r*(1.0/24 + r*(1.0/120 + r*(1.0/720 + r*(1.0/5040
+             + r*(1.0/40320 + r*(1.0/362880 + r*(1.0/3628800 + r*(1.0/39916800)))))))))));
+    // 2^n: the low bits of nr hold n (two's complement)
+    uint64_t nbits;
+    memcpy(&nbits, &nr, sizeof(nbits));
+    uint64_t scale = (nbits + 1023ULL) << 52;
+    memcpy(&f, &scale, sizeof(f));
+    double result = p*f;
+    result = z > -708.0 ? result : 0.0;
+    result = x > 0.0 ? result : 0.0;
+    return y > 0.0 ? result : 1.0;
+}
+
+#endif // HBV_FASTMATH_H
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_glue.h"
+#include "hbv_monitor.h"
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+hbv_glue::hbv_glue(hbv_model *base, hbv_metrics *metrics, string criterion, int nThreads) : hbv_pool(base, metrics, nThreads)
+{
+    nDays = base->getData().nDays;
+    hbv_span Qobs(base->getData().flow, nDays);
+    hbv_span precip(base->getData().precip, nDays);
+
+    // METRIC:VALUE
+    size_t colon = criterion.find(':');
+    likelihood = NULL;
+    if(colon != string::npos){
+        likelihood = new hbv_metrics(criterion.substr(0, colon), Qobs, precip, base->getWarmup());
+        threshold = atof(criterion.substr(colon+1).c_str());
+    }
+    if(likelihood == NULL || likelihood->size() != 1){
+        cout << "Invalid behavioural criterion " << criterion << " (METRIC:VALUE, e.g. nse:-0.5)" << endl;
+        exit(1);
+    }
+
+    runs = 0;
+    behavioural = 0;
+}
+
+hbv_glue::~hbv_glue()
+{
+    delete likelihood;
+}
+
+void hbv_glue::evaluate(int nSol, const double *vars, double *objs)
+{
+    weights.assign(nSol, 0.0);
+    parallel(nSol, [this, vars, objs](hbv_model *model, int i){
+        double *Qsim = model->getFluxes().Qsim;
+        chrono::steady_clock::time_point t0 = hbv_stats::start();
+        model->calc_HBV((double*)&vars[i*hbv_model::nParams]);
+        metrics->evaluate(hbv_span(Qsim, nDays), &objs[i*nobjs]);
+        hbv_stats::evaluation(t0, nDays);
+
+        double score;
+        likelihood->evaluate(hbv_span(Qsim, nDays), &score);
+        runs++;
+        if(!(score < threshold)) return;
+
+        // behavioural run: its flows are added to the bands with its weight
+        weights[i] = threshold - score;
+        if(bands != NULL) bands->add(threadIndex(model), Qsim, weights[i]);
+        behavioural++;
+    });
+}
+
+const double *hbv_glue::getWeights()
+{
+    return &weights[0];
+}
+
+void hbv_glue::printStatistics(ostream &out)
+{
+    out << "glue: " << behavioural << " behavioural runs out of " << runs << " ("
+        << (runs > 0 ? 100.0*behavioural/runs : 0.0) << "%)" << endl;
+}
@@ -0,0 +1,74 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_GLUE_H
+#define HBV_GLUE_H
+
+#include "hbv_pool.h"
+#include <vector>
+#include <string>
+#include <atomic>
+#include <ostream>
+
+namespace std{
+
+/**
+ * GLUE (Beven and Binley, 1992) evaluation of a Monte Carlo sample: each
+ * run is scored with an informal likelihood metric as soon as it is
+ * simulated and the runs with a score above the behavioural threshold
+ * (criterion METRIC:VALUE, behavioural if the metric, which is minimized,
+ * is below VALUE) get the likelihood weight VALUE - metric, e.g. NSE - 0.5
+ * for nse:-0.5. The flows of the behavioural runs are added to a weighted
+ * t-digest of each time step (hbv_bands, one set per thread), the others
+ * are discarded, so the memory does not depend on the sample size.
+ */
+class hbv_glue : public hbv_pool
+{
+public:
+
+    hbv_glue(hbv_model *base, hbv_metrics *metrics, string criterion, int nThreads);
+    virtual ~hbv_glue();
+
+    /**
+     * objectives of each run (all the runs are simulated, the cache is not used)
+     */
+    void evaluate(int nSol, const double *vars, double *objs);
+
+    /**
+     * likelihood weights of the runs of the last batch (0 = non-behavioural)
+     */
+    const double *getWeights();
+
+    virtual void printStatistics(ostream &out);
+
+protected:
+
+    hbv_metrics *likelihood;
+    double threshold;
+    int nDays;
+    vector<double> weights;
+
+    // statistics
+    atomic<long> runs;
+    atomic<long> behavioural;
+
+};
+}
+
+#endif // HBV_GLUE_H
@@ -0,0 +1,318 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_metrics.h"
+#include "hbv_signatures.h"
+#include "hbv_options.h"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+const char *hbv_metrics::names[hbv_metrics::NMETRICS] = {
+    "alpha", "beta", "r", "nse", "kge", "kge2012", "kge2021", "lognse", "sqrtnse", "rmse", "pbias", "peak", "lowflow",
+    "loglik", "loglik_log", "loglik_hetero", "sig_rr", "sig_bfi", "sig_recession", "sig_fdc", "sig_q5", "sig_q95"
+};
+
+string hbv_metrics::available(){
+
+    string s;
+    for(int i=0; i<NMETRICS; i++){
+        s += names[i];
+        if(i < NMETRICS-1) s += ",";
+    }
+    return s;
+}
+
+hbv_metrics::hbv_metrics(string list, hbv_span Qobs, hbv_span precip, int warmup){
+
+    // selected metrics
+    vector<string> items = parseNames(list);
+    for(unsigned int k=0; k<items.size(); k++){
+        int m = 0;
+        while(m < NMETRICS && items[k] != names[m]) m++;
+        if(m == NMETRICS){
+            cout << "Unknown metric " << items[k] << " (available: " << available() << ")" << endl;
+            exit(1);
+        }
+        selected.push_back(m);
+    }
+    needMoments = needLog = needSqrt = needHetero = false;
+    signatures = NULL;
+    for(unsigned int k=0; k<selected.size(); k++){
+        int m = selected[k];
+        if(m >= SIG_RR && signatures == NULL) signatures = new hbv_signatures(Qobs, precip, warmup);
+        if(m == ALPHA || m == BETA || m == R || m == KGE || m == KGE2012 || m == KGE2021) needMoments = true;
+        if(m == LOGNSE || m == LOGLIK_LOG) needLog = true;
+        if(m == LOGLIK_HETERO) needHetero = true;
+        if(m == SQRTNSE) needSqrt = true;
+    }
+
+    // observations after the warm-up
+    this->warmup = warmup;
+    n = max(Qobs.size - warmup, 0);
+    obs = Qobs.data + warmup;
+
+    weight.resize(n);
+    nObs = 0.0;
+    meanObs = 0.0;
+    for(int i=0; i<n; i++){
+        weight[i] = obs[i] >= 0.0 ? 1.0 : 0.0;
+        nObs += weight[i];
+        meanObs += weight[i]*max(obs[i], 0.0);
+    }
+    meanObs /= nObs;
+
+    devObs.resize(n);
+    varObs = 0.0;
+    for(int i=0; i<n; i++){
+        devObs[i] = weight[i]*(obs[i] - meanObs);
+        varObs += devObs[i]*devObs[i];
+    }
+    varObs /= nObs;
+
+    // transformed observations (log: Pushpalatha et al., 2012)
+    logEps = meanObs/100.0;
+    logObs.resize(n);
+    sqrtObs.resize(n);
+    double meanLog = 0.0, meanSqrt = 0.0;
+    for(int i=0; i<n; i++){
+        logObs[i] = weight[i]*log(max(obs[i], 0.0) + logEps);
+        sqrtObs[i] = weight[i]*sqrt(max(obs[i], 0.0));
+        meanLog += logObs[i];
+        meanSqrt += sqrtObs[i];
+    }
+    meanLog /= nObs;
+    meanSqrt /= nObs;
+    sstLog = 0.0;
+    sstSqrt = 0.0;
+    for(int i=0; i<n; i++){
+        sstLog += weight[i]*(logObs[i] - meanLog)*(logObs[i] - meanLog);
+        sstSqrt += weight[i]*(sqrtObs[i] - meanSqrt)*(sqrtObs[i] - meanSqrt);
+    }
+
+    // errors with standard deviation growing with the flow (sigma = a + b*Qobs)
+    invSigma.resize(n);
+    sumLogSigma = 0.0;
+    for(int i=0; i<n; i++){
+        double sigma = 0.1*meanObs + 0.1*max(obs[i], 0.0);
+        invSigma[i] = weight[i]/sigma;
+        sumLogSigma += weight[i]*log(sigma);
+    }
+
+    // high and low flows, from the percentiles of the observations
+    vector<double> sorted;
+    for(int i=0; i<n; i++){
+        if(weight[i] > 0.0) sorted.push_back(obs[i]);
+    }
+    double qHigh = 0.0, qLow = 0.0;
+    if(!sorted.empty()){
+        nth_element(sorted.begin(), sorted.begin() + int(0.98*(sorted.size()-1)), sorted.end());
+        qHigh = sorted[int(0.98*(sorted.size()-1))];
+        nth_element(sorted.begin(), sorted.begin() + int(0.30*(sorted.size()-1)), sorted.end());
+        qLow = sorted[int(0.30*(sorted.size()-1))];
+    }
+    highWeight.resize(n);
+    lowWeight.resize(n);
+    highVolume = 0.0;
+    lowVolume = 0.0;
+    for(int i=0; i<n; i++){
+        highWeight[i] = (weight[i] > 0.0 && obs[i] > qHigh) ? 1.0 : 0.0;
+        lowWeight[i] = (weight[i] > 0.0 && obs[i] <= qLow) ? 1.0 : 0.0;
+        highVolume += highWeight[i]*obs[i];
+        lowVolume += lowWeight[i]*obs[i];
+    }
+
+    // relative errors, or absolute errors if the observed value is zero (e.g.
+    // no flow 95% of the time in intermittent catchments)
+    highScale = relativeScale(PEAK, highVolume);
+    lowScale = relativeScale(LOWFLOW, lowVolume);
+    if(signatures != NULL){
+        for(int s=0; s<hbv_signatures::NSIGNATURES; s++){
+            sigScale.push_back(relativeScale(SIG_RR + s, signatures->getObserved(s)));
+        }
+    }
+}
+
+double hbv_metrics::relativeScale(int metric, double observed){
+    if(fabs(observed) > 1.0e-9) return fabs(observed);
+    if(find(selected.begin(), selected.end(), metric) != selected.end()){
+        cerr << "Observed value of " << names[metric] << " is zero: absolute error used instead of the relative one" << endl;
+    }
+    return 1.0;
+}
+
+hbv_metrics::~hbv_metrics(){
+    delete signatures;
+}
+
+int hbv_metrics::size(){
+    return selected.size();
+}
+
+string hbv_metrics::getName(int i){
+    return names[selected[i]];
+}
+
+
+void hbv_metrics::evaluate(hbv_span Qsim, double *objs){
+
+    const double *sim = Qsim.data + warmup;
+    const double *w = &weight[0];
+    const double *o = obs;
+
+    // first pass: mean of the simulated flows, errors and volumes
+    double sumSim = 0.0, sse = 0.0, sumErr = 0.0, highErr = 0.0, lowErr = 0.0;
+    const double *hw = &highWeight[0];
+    const double *lw = &lowWeight[0];
+    #pragma omp simd reduction(+:sumSim,sse,sumErr,highErr,lowErr)
+    for(int i=0; i<n; i++){
+        double e = w[i]*(sim[i] - o[i]);
+        sumSim += w[i]*sim[i];
+        sse += e*e;
+        sumErr += e;
+        highErr += hw[i]*e;
+        lowErr += lw[i]*e;
+    }
+    double meanSim = sumSim/nObs;
+
+    // second pass (only if needed): variance and covariance
+    double varSim = 0.0, cov = 0.0;
+    if(needMoments){
+        const double *dObs = &devObs[0];
+        #pragma omp simd reduction(+:varSim,cov)
+        for(int i=0; i<n; i++){
+            double d = w[i]*(sim[i] - meanSim);
+            varSim += d*d;
+            cov += d*dObs[i];
+        }
+        varSim /= nObs;
+        cov /= nObs;
+    }
+
+    // transformed flows (only if needed)
+    double sseLog = 0.0, sseSqrt = 0.0;
+    if(needLog){
+        const double *lo = &logObs[0];
+        double eps = logEps;
+        #pragma omp simd reduction(+:sseLog)
+        for(int i=0; i<n; i++){
+            double e = w[i]*log(max(sim[i], 0.0) + eps) - lo[i];
+            sseLog += e*e;
+        }
+    }
+    if(needSqrt){
+        const double *so = &sqrtObs[0];
+        #pragma omp simd reduction(+:sseSqrt)
+        for(int i=0; i<n; i++){
+            double e = w[i]*sqrt(max(sim[i], 0.0)) - so[i];
+            sseSqrt += e*e;
+        }
+    }
+
+    double sseHetero = 0.0;
+    if(needHetero){
+        const double *is = &invSigma[0];
+        #pragma omp simd reduction(+:sseHetero)
+        for(int i=0; i<n; i++){
+            double e = (sim[i] - o[i])*is[i];
+            sseHetero += e*e;
+        }
+    }
+
+    // signatures (only if needed)
+    double sig[hbv_signatures::NSIGNATURES];
+    if(signatures != NULL){
+        signatures->compute(Qsim, sig);
+    }
+
+    // metrics
+    double sdSim = sqrt(varSim);
+    double sdObs = sqrt(varObs);
+    double r = cov/(sdSim*sdObs);
+    double alpha = sdSim/sdObs;
+    for(unsigned int k=0; k<selected.size(); k++){
+        double value = 0.0;
+        switch(selected[k]){
+        case ALPHA:     // relative variability (Gupta et al., 2009)
+            value = alpha;
+            break;
+        case BETA:      // absolute value of the bias, relative to the st.dev. of the observations
+            value = fabs(meanSim - meanObs)/sdObs;
+            break;
+        case R:         // correlation coefficient (maximized)
+            value = -r;
+            break;
+        case NSE:       // Nash-Sutcliffe efficiency (maximized)
+            value = -(1.0 - sse/(varObs*nObs));
+            break;
+        case KGE:       // Kling-Gupta efficiency (Gupta et al., 2009, maximized)
+            value = -(1.0 - sqrt((r-1)*(r-1) + (alpha-1)*(alpha-1) + (meanSim/meanObs-1)*(meanSim/meanObs-1)));
+            break;
+        case KGE2012:   // with the ratio of the coefficients of variation (Kling et al., 2012, maximized)
+        {
+            double gamma = (sdSim/meanSim)/(sdObs/meanObs);
+            value = -(1.0 - sqrt((r-1)*(r-1) + (gamma-1)*(gamma-1) + (meanSim/meanObs-1)*(meanSim/meanObs-1)));
+            break;
+        }
+        case KGE2021:   // with the bias relative to the st.dev. (Tang et al., 2021, maximized)
+        {
+            double b = (meanSim - meanObs)/sdObs;
+            value = -(1.0 - sqrt((r-1)*(r-1) + (alpha-1)*(alpha-1) + b*b));
+            break;
+        }
+        case LOGNSE:    // NSE of the log-transformed flows (maximized)
+            value = -(1.0 - sseLog/sstLog);
+            break;
+        case SQRTNSE:   // NSE of the sqrt-transformed flows (maximized)
+            value = -(1.0 - sseSqrt/sstSqrt);
+            break;
+        case RMSE:      // root mean square error
+            value = sqrt(sse/nObs);
+            break;
+        case PBIAS:     // absolute value of the percent bias
+            value = fabs(100.0*sumErr/(meanObs*nObs));
+            break;
+        case PEAK:      // absolute relative volume error on the high flows
+            value = fabs(highErr)/highScale;
+            break;
+        case LOWFLOW:   // absolute relative volume error on the low flows
+            value = fabs(lowErr)/lowScale;
+            break;
+        case LOGLIK:    // Gaussian iid errors, with their variance integrated out (Box and Tiao, 1973)
+            value = 0.5*nObs*log(sse);
+            break;
+        case LOGLIK_LOG: // same, for the log-transformed flows
+            value = 0.5*nObs*log(sseLog);
+            break;
+        case LOGLIK_HETERO: // Gaussian errors with standard deviation 0.1*mean(Qobs) + 0.1*Qobs
+            value = sumLogSigma + 0.5*sseHetero;
+            break;
+        default:        // absolute relative error of a signature
+        {
+            int s = selected[k] - SIG_RR;
+            double o = signatures->getObserved(s);
+            value = fabs(sig[s] - o)/sigScale[s];
+            break;
+        }
+        }
+        objs[k] = value;
+    }
+}
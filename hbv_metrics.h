@@ -0,0 +1,114 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_METRICS_H
+#define HBV_METRICS_H
+
+#include <vector>
+#include <string>
+
+namespace std{
+
+class hbv_signatures;
+
+/**
+ * non-owning view of a time series
+ */
+struct hbv_span
+{
+    const double *data;
+    int size;
+    hbv_span(const double *data, int size) : data(data), size(size) {}
+};
+
+/**
+ * performance metrics of the simulated flows w.r.t. the observations,
+ * selected at runtime by name (e.g. "alpha,beta,r" or "kge,lognse").
+ * Metrics to be maximized are returned with the opposite sign, so that all
+ * the objectives are minimized. The first warmup time steps are not
+ * evaluated and negative observations are treated as missing.
+ * The statistics of the observations are computed once, and each evaluation
+ * only computes the sums needed by the selected metrics (shared among them).
+ * Signature metrics (sig_*) are the absolute relative errors of the
+ * hydrologic signatures (see hbv_signatures). Likelihood metrics (loglik*)
+ * are negative log-likelihoods (up to a constant) for Bayesian inference.
+ */
+class hbv_metrics
+{
+public:
+
+    hbv_metrics(string names, hbv_span Qobs, hbv_span precip, int warmup);
+    virtual ~hbv_metrics();
+
+    /**
+     * number and names of the selected metrics
+     */
+    int size();
+    string getName(int i);
+
+    /**
+     * compute the selected metrics of the simulated flows (whole record)
+     */
+    void evaluate(hbv_span Qsim, double *objs);
+
+    /**
+     * list of the available metrics
+     */
+    static string available();
+
+protected:
+
+    enum metric { ALPHA, BETA, R, NSE, KGE, KGE2012, KGE2021, LOGNSE, SQRTNSE, RMSE, PBIAS, PEAK, LOWFLOW,
+                  LOGLIK, LOGLIK_LOG, LOGLIK_HETERO, SIG_RR, SIG_BFI, SIG_RECESSION, SIG_FDC, SIG_Q5, SIG_Q95, NMETRICS };
+    static const char *names[NMETRICS];
+
+    // denominator of a relative error (warning if zero for a selected metric)
+    double relativeScale(int metric, double observed);
+
+    vector<int> selected;
+    bool needMoments;   // means, variances and covariance
+    bool needLog;       // log-transformed flows
+    bool needSqrt;      // sqrt-transformed flows
+    bool needHetero;    // errors weighted by their standard deviation
+    hbv_signatures *signatures; // only if signature metrics are selected
+
+    // observations after the warm-up and their statistics
+    int warmup;
+    int n;
+    const double *obs;
+    vector<double> weight;      // 1 if observed, 0 if missing
+    vector<double> devObs;      // weighted deviations from the mean
+    vector<double> logObs;
+    vector<double> sqrtObs;
+    vector<double> invSigma;    // 1/standard deviation of the errors (heteroscedastic likelihood)
+    double sumLogSigma;
+    vector<double> highWeight;  // observed high flows (above the 98th percentile)
+    vector<double> lowWeight;   // observed low flows (below the 30th percentile)
+    double nObs, meanObs, varObs;
+    double sstLog, sstSqrt;
+    double logEps;              // added before the log transformation
+    double highVolume, lowVolume;
+    // denominators of the relative errors (peak, lowflow and signatures):
+    // the observed value, or 1 (absolute error) if it is zero
+    double highScale, lowScale;
+    vector<double> sigScale;
+
+};
+}
+
+#endif // HBV_METRICS_H
@@ -16,11 +16,16 @@ along with HBV.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "hbv_model.h"
+#include "hbv_stream.h"
 
 using namespace std;
 
 #define PI 3.141592
 
+// parameter ranges: K2, K1, K0, MAXBAS, DDF, TB, TTH, PERC, BETA, LP, FC, L
+const double hbv_model::paramMin[hbv_model::nParams] = {10.0, 1.0, 0.5, 24.0, 0.0, -3.0, -3.0, 0.0, 0.0, 0.3, 10.0, 0.0};
+const double hbv_model::paramMax[hbv_model::nParams] = {20000.0, 100.0, 20.0, 120.0, 20.0, 3.0, 3.0, 100.0, 7.0, 1.0, 2000.0, 100.0};
+
 
 hbv_model::hbv_model() {
     // TODO Auto-generated constructor stub
@@ -33,27 +38,89 @@ hbv_model::~hbv_model() {
 
 hbv_model::hbv_model(string dataFile)
 {
+    sharedData = false;
+    storeStates = true;
+    fastPow = false;
+    scenario = NULL;
+    ownScenario = false;
+    scenarioPE = NULL;
+
     //Read input data and allocate internal arrays
-    readData(dataFile);
+    readData(dataFile, 0);
 
     //Calculate the Hamon Potential Evaporation for the time series
-    calculateHamonPE(startingIndex, data.nDays, dayStartIndex);
+    evap.PE = new double [data.nDays*data.nZones];
+    calculateHamonPE(startingIndex, data.nDays, dayStartIndex, evap.PE, NULL);
 
 }
 
 
-void hbv_model::hbv_allocate(int nDays)
+hbv_model::hbv_model(string dataFile, int chunkSteps)
+{
+    sharedData = false;
+    storeStates = false;
+    fastPow = false;
+    scenario = NULL;
+    ownScenario = false;
+    scenarioPE = NULL;
+
+    //Header only: the arrays hold the last time step of the previous chunk and the next chunkSteps
+    readData(dataFile, chunkSteps);
+    evap.PE = new double [data.nDays*data.nZones];
+    streamYear = 0;
+    streamDay = 0;
+}
+
+
+hbv_model::hbv_model(hbv_model *base)
+{
+    sharedData = true;
+
+    //Input data and PE are read-only during the simulation: share them
+    data = base->data;
+    evap = base->evap;
+    dayStartIndex = base->dayStartIndex;
+    startingIndex = base->startingIndex;
+    tst = base->tst;
+    storeStates = true;
+    fastPow = base->fastPow;
+    scenario = base->scenario;
+    ownScenario = false;
+    scenarioPE = NULL;
+
+    //States and fluxes are private to this instance
+    hbv_allocate(data.nDays);
+}
+
+
+hbv_model::hbv_model(hbv_model *base, const hbv_scenario &scenario) : hbv_model(base)
 {
-    states.stw1   = new double [nDays];
-    states.stw2   = new double [nDays];
+    this->scenario = new hbv_scenario(scenario);
+    ownScenario = true;
 
-    states.sowat   = new double [nDays];
-    states.sdep    = new double [nDays];
+    //PE of the months with a temperature change, the others are those of base
+    bool changed = false;
+    for (int m = 0; m < 12; m++) changed = changed || scenario.tempDelta[m] != 0.0;
+    if (changed)
+    {
+        int n = data.nDays*data.nZones;
+        scenarioPE = new double [n];
+        for (int i = 0; i < n; i++) scenarioPE[i] = base->evap.PE[i];
+        calculateHamonPE(startingIndex, data.nDays, dayStartIndex, scenarioPE, scenario.tempDelta);
+        evap.PE = scenarioPE;
+    }
+}
 
-    tst = 24*3600; // daily timestep
+
+void hbv_model::hbv_allocate(int nDays)
+{
+    allocateStates(nDays);
+    zoneWork       = new double [data.nZones];
 
     // (these will be reset after MaxBas is read in)
     fluxes.Qrouting = new double [1];
+    routingWeights = new double [1];
+    currentDay = 0;
     
     //Allocate the array used to store the modelled Q, and other things
     fluxes.Qsim = new double [nDays];
@@ -63,149 +130,111 @@ void hbv_model::hbv_allocate(int nDays)
 }
 
 
-double hbv_model::snow(int modelDay)
+void hbv_model::allocateStates(int nDays)
 {
-    double smelt = 0.0;
-    double eff_precip = 0.0; //effective precip initialized to zero
+    // without the trajectory only today and yesterday are stored (see slot())
+    int nSlots = storeStates ? nDays : 2;
 
-    // Read in temperature and precip data for this time step
-    double avg_temp = data.avgTemp[startingIndex + modelDay];
-    double precip = data.precip[startingIndex + modelDay];
+    states.stw1   = new double [nSlots];
+    states.stw2   = new double [nSlots];
 
-    // starting point: equal to yesterday
-    states.sdep[modelDay] = states.sdep[modelDay-1];
+    states.sowat   = new double [nSlots*data.nZones];
+    states.sdep    = new double [nSlots*data.nZones];
 
-    // Snow/Rain
-    if (avg_temp < params.ttlim)
-        states.sdep[modelDay] += precip;    // if temperature is lower than threshold (ttlim) --> precip is all snow
-	else 
-        eff_precip += precip;               // otherwise --> add precip to effective precip
+    return;
+}
 
-    // Snow melt if temperature > threshold (degw)
-    if (avg_temp > params.degw)
-    {
-        //If there is actually snow to melt in the snow store...
-        if (states.sdep[modelDay] > 0.0)
-        {
-            //Calculate snow melt using degree-day factor (degd)
-            smelt = (avg_temp - params.degw)*params.degd;
-            //If snow melt that wants to occur is more than what is actually stored...
-            if (smelt > states.sdep[modelDay])
-            {
-                eff_precip += states.sdep[modelDay];    //add full snow depth to effective precip
-                states.sdep[modelDay] = 0.0;            //All of the snow has melted
-            }
-            else //Otherwise, we melt a portion of the snow store
-            {
-                eff_precip += smelt;                //effective precip is precip together with what acutally melted
-                states.sdep[modelDay] -= smelt;     //Remove the amount that melted from the snow store
-            }
-        }
-    }
 
-    return eff_precip;
+void hbv_model::setFastPow(bool fast)
+{
+    fastPow = fast;
 }
 
 
-void hbv_model::soil(double eff_precip, int modelDay)
+void hbv_model::setStoreStates(bool store)
 {
-    double hsw, AET, runoff_depth;
+    if (store == storeStates) return;
 
-    double fcap = params.fcap;
-    double lp = params.lp;
-    double beta = params.beta;
-    double PET = evap.PE[modelDay];
+    delete[] states.stw1;
+    delete[] states.stw2;
+    delete[] states.sowat;
+    delete[] states.sdep;
 
-    // starting point: equal to yesterday's storage
-    states.sowat[modelDay] = states.sowat[modelDay-1];
+    storeStates = store;
+    allocateStates(data.nDays);
 
-    //If the soil moisture storage is already at capacity, runoff = all precip + excess
-    if (states.sowat[modelDay] >= fcap) {
-        runoff_depth = eff_precip + (states.sowat[modelDay] - fcap);
-        states.sowat[modelDay] = fcap;
-    }
-    else
-    {
-        //This is the portion of the effective precip that goes into storage
-        hsw = eff_precip * (1.0 - pow((states.sowat[modelDay]/fcap), beta));
-        states.sowat[modelDay] += hsw;
-        runoff_depth = eff_precip - hsw;
+    return;
+}
 
-        //If the amount going into the soil moisture storage will result in exceeding the capacity of the store...
-        if (states.sowat[modelDay] > fcap)
-        {
-            runoff_depth += (states.sowat[modelDay] - fcap);
-            states.sowat[modelDay] = fcap; //We are at capacity
-        }
-    }
 
-    AET = PET*min(states.sowat[modelDay-1]/(fcap*lp), 1.0); // actual ET, after adjusting for saturation in soil layer
-    if (AET < 0.0) AET = 0.0;
+void hbv_model::snow(int modelDay, double *eff_precip)
+{
+    int nZones = data.nZones;
+
+    // Read in temperature and precip data for this time step
+    double avg_temp, precip;
+    forcing(startingIndex + modelDay, precip, avg_temp);
 
-    //If there is enough in the soil moisture store to supply the AET, subtract it
-    if (states.sowat[modelDay] > AET) {
-        fluxes.actualET[modelDay] = AET;
-        states.sowat[modelDay] -= AET;
-    }
-    else {
-        fluxes.actualET[modelDay] = states.sowat[modelDay];
-        states.sowat[modelDay] = 0.0; // all of it evaporates
-    }
+    // snow store of each zone today and yesterday
+    double *sdep = &states.sdep[slot(modelDay)*nZones];
+    const double *sdep_old = &states.sdep[slot(modelDay-1)*nZones];
 
-    states.stw1[modelDay] += states.stw1[modelDay-1] + runoff_depth;
+    // Zones are independent: the loop has no branches so that zones map to SIMD lanes
+    #pragma omp simd
+    for (int z = 0; z < nZones; z++)
+    {
+        // zone temperature, corrected with the lapse rate
+        double temp = avg_temp + data.zoneDeltaT[z];
+        snowZone(temp, precip, sdep_old[z], params, sdep[z], eff_precip[z]);
+    }
 
     return;
 }
 
 
-double hbv_model::discharge(int modelDay)
+void hbv_model::soil(const double *eff_precip, int modelDay)
 {
+    // the choice of the power function is made once per step, outside the zone loop
+    if (fastPow) soilZones<true>(eff_precip, modelDay);
+    else soilZones<false>(eff_precip, modelDay);
+}
 
-    double Q0, Q1, Q2, Qall;
 
-    //If the upper reservoir water level is above the threshold for near surface flow
-    if (states.stw1[modelDay] > params.hl1)
+template<bool fast> void hbv_model::soilZones(const double *eff_precip, int modelDay)
+{
+    int nZones = data.nZones;
+    double runoff_depth = 0.0;
+    double actualET = 0.0;
+
+    // soil storage of each zone today and yesterday
+    double *sowat = &states.sowat[slot(modelDay)*nZones];
+    const double *sowat_old = &states.sowat[slot(modelDay-1)*nZones];
+    const double *PE = &evap.PE[modelDay*nZones];
+
+    // Zones are independent: runoff and AET are weighted by the zone area
+    #pragma omp simd reduction(+:runoff_depth,actualET)
+    for (int z = 0; z < nZones; z++)
     {
-        //Calculate it, and remove it from the reservoir
-        Q0 = (states.stw1[modelDay] - params.hl1)*params.ck0;
-        states.stw1[modelDay] -= Q0;
-    }
-    else Q0 = 0.0;
+        // starting point: equal to yesterday's storage
+        double runoff, et;
+        soilZone<fast>(sowat_old[z], eff_precip[z], PE[z], params, sowat[z], runoff, et);
 
-    //If there is still water left in the upper reservoir
-    if (states.stw1[modelDay] > 0.0)
-    {
-        //Calculate what now goes into interflow, and remove it
-        Q1 = states.stw1[modelDay] * params.ck1;
-        states.stw1[modelDay] -= Q1;
+        runoff_depth += data.zoneArea[z]*runoff;
+        actualET += data.zoneArea[z]*et;
     }
-    else Q1 = 0.0;
 
-    //If there is still anough water in the upper reservois to completely supply percolation...
-    if (states.stw1[modelDay] > params.perc)
-    {
-        // Move the amount from the upper to the lower reservoir
-        states.stw1[modelDay] -= params.perc;
-        states.stw2[modelDay] += params.perc;
-    }
-    else
-    {
-        //We just put what we can from the upper into the lower
-        states.stw2[modelDay] += states.stw1[modelDay];
-        states.stw1[modelDay] = 0.0;
-    }
+    fluxes.actualET[modelDay] = actualET;
+    states.stw1[slot(modelDay)] += states.stw1[slot(modelDay-1)] + runoff_depth;
+
+    return;
+}
 
-    //If there is water in the lower reservoir...
-    if (states.stw2[modelDay] > 0.0)
-    {
-        //Calculate base flow, and remove it
-        Q2 = states.stw2[modelDay] * params.ck2;
-        states.stw2[modelDay] -= Q2;
-    }
-    else Q2 = 0.0;
 
-    Qall = (Q0 + Q1 + Q2); // total dischargearge - mm per timestep
-    return Qall;
+double hbv_model::discharge(int modelDay)
+{
+    // Overflow, interflow, percolation and baseflow of the reservoirs
+    int t = slot(modelDay);
+    return reservoirs(states.stw1[t], states.stw2[t], params);
 }
 
 
@@ -216,10 +245,6 @@ void hbv_model::routing(double Qall, int modelDay)
     ///////////////////////////////////////////////////////////
     //Qall | Q0+Q1+Q2 | Total dischargearge from both reservoirs
 
-    int m2;
-    double wsum;
-    double *wei = new double [params.maxbas];
-
     ///////////////////////////////////////////////////////////
     //Variable in code | variable in manual/lit | description
     ///////////////////////////////////////////////////////////
@@ -227,56 +252,69 @@ void hbv_model::routing(double Qall, int modelDay)
     //Qrouting | NA | This is the flow from the single Qall spread out over time according to the transformation function
     //Qsim | NA | The final flow output by the model
 
-    m2   = (params.maxbas / 2)-1;
-    wsum =  0.0;
-
-    //Calculate the values of the transformation function according to maxbas
-    for (int i=0; i< params.maxbas; i++)
-    {
-        if (i <= m2) wei[i] = double(i+1);
-        else wei[i] = double(params.maxbas - (i+1)) + 1.0;
-        wsum += wei[i];
-    }
+    int klen = 2*params.maxbas;
+    double *wei = routingWeights;
 
     //Now, spread the flow Qall out over Qind according to the transformation function
+    //(Qrouting is a circular buffer starting at routingHead)
     for (int i=0; i < params.maxbas; i++)
     {
-        wei[i] /= wsum;
+        int k = routingHead + i;
+        if (k >= klen) k -= klen;
         //Qind is constantly added to by the transformed Qall.  In other words, when Qall is transformed (spread out over time)
         //it is then added to whatever currently exists in Qind for those time steps.  In other words, a previous transformation of
         //Qall for the previous time step placed flows in Qind in times that overlapped with the currently transformed flow times.
-        fluxes.Qrouting[i] += Qall * wei[i];
+        fluxes.Qrouting[k] += Qall * wei[i];
     }
 
-    fluxes.Qsim[modelDay] = fluxes.Qrouting[0];
+    fluxes.Qsim[modelDay] = fluxes.Qrouting[routingHead];
 
-    delete[] wei;
     return;
 }
 
 
 void hbv_model::backflow()
 {
-    int klen = 2*params.maxbas-1;
-  
-    for (int k = 0; k < klen; k++)
-    {
-        fluxes.Qrouting[k] = fluxes.Qrouting[k+1];
-    }
-    fluxes.Qrouting[klen] = 0.0;
+    int klen = 2*params.maxbas;
+
+    //The current step leaves the buffer and its place becomes the last one
+    fluxes.Qrouting[routingHead] = 0.0;
+    routingHead++;
+    if (routingHead >= klen) routingHead = 0;
     return;
 }
 
 
 void hbv_model::reinitForMaxBas()
 {
+    int m2;
+    double wsum;
+
     delete[] fluxes.Qrouting;
     fluxes.Qrouting = new double [2*params.maxbas];
+    delete[] routingWeights;
+    routingWeights = new double [params.maxbas];
 
     for (int i = 0; i < 2*params.maxbas; i++)
     {
         fluxes.Qrouting[i] = 0.0;
     }
+    routingHead = 0;
+
+    m2   = (params.maxbas / 2)-1;
+    wsum =  0.0;
+
+    //Calculate the values of the transformation function according to maxbas
+    for (int i=0; i< params.maxbas; i++)
+    {
+        if (i <= m2) routingWeights[i] = double(i+1);
+        else routingWeights[i] = double(params.maxbas - (i+1)) + 1.0;
+        wsum += routingWeights[i];
+    }
+    for (int i=0; i< params.maxbas; i++)
+    {
+        routingWeights[i] /= wsum;
+    }
 
     return;
 }
@@ -288,10 +326,20 @@ void hbv_model::hbv_delete(int nDays)
     delete[] states.sowat;
     delete[] states.sdep;
     delete[] fluxes.Qrouting;
+    delete[] routingWeights;
     delete[] fluxes.Qsim;
     delete[] fluxes.actualET;
+    delete[] zoneWork;
+    if (ownScenario)
+    {
+        delete scenario;
+        delete[] scenarioPE;
+    }
 
-    for (int i = 0; i < nDays; i++) delete[] data.date[i];
+    // input data are released by the instance which read them
+    if(sharedData) return;
+
+    delete[] data.date[0];
     delete[] data.date;
     delete[] data.precip;
     delete[] data.evap;
@@ -302,6 +350,9 @@ void hbv_model::hbv_delete(int nDays)
         delete[] data.minTemp;
     }
     delete[] data.avgTemp;
+    delete[] data.zoneArea;
+    delete[] data.zoneElev;
+    delete[] data.zoneDeltaT;
 
     return;
 }
@@ -313,11 +364,11 @@ void hbv_model::setParameters(double* parameters){
     params.ck2 = 1.0 / parameters[0] * tst / (3600.0 * 24.0);
     params.ck1 = 1.0 / parameters[1] * tst / (3600.0 * 24.0);
     params.ck0 = 1.0 / parameters[2] * tst / (3600.0 * 24.0);
-    params.maxbas  = ROUNDINT(parameters[3] / 24); // Number of days for hydrograph routing
+    params.maxbas  = max(ROUNDINT(parameters[3] / (tst / 3600.0)), 1); // Number of time steps for hydrograph routing (entered in hours)
     params.degd = parameters[4] * tst / (3600.0 * 24.0); // Degree-day factor [mm/(degC-d)]
     params.degw = parameters[5]; // Snowmelt threshold [degC]
     params.ttlim = parameters[6]; // Temp to start snowing [degC]
-    params.perc = parameters[7]; // Percolation [mm/d]
+    params.perc = parameters[7] * (tst / (3600.0 * 24.0)); // Percolation [mm/d], converted to mm per time step
     params.beta = parameters[8]; // Beta (soil moisture exponent, unitless)
     params.lp = parameters[9]; // Unitless evaporation constant
     params.fcap = parameters[10]; // Max storage of soil layer [mm]
@@ -329,11 +380,16 @@ void hbv_model::setParameters(double* parameters){
 void hbv_model::reinitStateFluxes(){
 
     // set states and fluxes to zero
-    for(int k=0; k<data.nDays; k++){
+    int nSlots = storeStates ? data.nDays : 2;
+    for(int k=0; k<nSlots*data.nZones; k++){
         states.sdep[k] = 0.0;
         states.sowat[k] = 0.0;
+    }
+    for(int k=0; k<nSlots; k++){
         states.stw1[k] = 0.0;
         states.stw2[k] = 0.0;
+    }
+    for(int k=0; k<data.nDays; k++){
         fluxes.actualET[k] = 0.0;
         fluxes.Qsim[k] = 0.0;
     }
@@ -342,40 +398,99 @@ void hbv_model::reinitStateFluxes(){
 
 
 void hbv_model::calc_HBV(double* parameters)
+{
+    start(parameters);
+    run(1, data.nDays);
+}
+
+
+void hbv_model::start(double* parameters)
 {
     // set parameters and reinitialize HBV
     setParameters(parameters);
     reinitStateFluxes();
     reinitForMaxBas();
+    currentDay = 0;
+}
 
-    // Now run the components of the model
-    double Qall, eff_precip;
 
-    // Run over daily timesteps (starting at 1)
-    for (int day = 1; day < data.nDays; day++)
+void hbv_model::run(int firstDay, int lastDay)
+{
+    // Run over the timesteps (starting at 1)
+    for (int day = firstDay; day < lastDay; day++)
     //for (int day = 1; day < 10; day++)
     {
-        //Degree-day snow module (sets eff_precip value)
-        eff_precip = snow(day);
+        step(day);
+    }
+    if (lastDay > firstDay) currentDay = lastDay - 1;
+
+    return;
+}
 
-        //Soil/ET module (sets runoff_depth value)
-        soil(eff_precip, day);
 
-        // Calculate the resulting dischargearge Qall
-        Qall = discharge(day);
+void hbv_model::saveState(hbv_snapshot &s)
+{
+    int t = slot(currentDay);
+    int nZones = data.nZones;
+    s.day = currentDay;
+    s.sowat.assign(&states.sowat[t*nZones], &states.sowat[(t+1)*nZones]);
+    s.sdep.assign(&states.sdep[t*nZones], &states.sdep[(t+1)*nZones]);
+    s.stw1 = states.stw1[t];
+    s.stw2 = states.stw2[t];
+
+    // the circular buffer is saved in time order
+    int klen = 2*params.maxbas;
+    s.Qrouting.resize(klen);
+    for (int i = 0; i < klen; i++) s.Qrouting[i] = fluxes.Qrouting[(routingHead + i) % klen];
+}
 
-        // Route Qall using MaxBas routing
-        routing(Qall, day);
 
-        // Shift the routing arrays to the next timestep
-        backflow();
+void hbv_model::loadState(const hbv_snapshot &s)
+{
+    int t = slot(s.day);
+    int nZones = data.nZones;
+    for (int z = 0; z < nZones; z++)
+    {
+        states.sowat[t*nZones+z] = s.sowat[z];
+        states.sdep[t*nZones+z] = s.sdep[z];
     }
+    states.stw1[t] = s.stw1;
+    states.stw2[t] = s.stw2;
 
-    return;
+    for (int i = 0; i < 2*params.maxbas; i++) fluxes.Qrouting[i] = s.Qrouting[i];
+    routingHead = 0;
+    currentDay = s.day;
+}
+
+
+int hbv_model::loadForcing(hbv_forcing_source &source, bool continued)
+{
+    int nZones = data.nZones;
+    int first = 0;
+    if (continued)
+    {
+        //The last simulated time step becomes the first one of the chunk
+        for (int k = 0; k < 4; k++) data.date[0][k] = data.date[currentDay][k];
+        data.precip[0] = data.precip[currentDay];
+        data.avgTemp[0] = data.avgTemp[currentDay];
+        for (int z = 0; z < nZones; z++) evap.PE[z] = evap.PE[currentDay*nZones+z];
+        first = 1;
+    }
+
+    int n = source.read(data.nDays - first, data.date[first], &data.precip[first], &data.avgTemp[first]);
+    if (n == 0) return 0;
+
+    //The day of the year continues from the previous chunk (chunks end with whole days)
+    int startDay = !continued ? dayStartIndex : (data.date[first][0] == streamYear ? streamDay + 1 : 1);
+    streamDay = calculateHamonPE(first, n, startDay, &evap.PE[first*nZones], NULL);
+    streamYear = data.date[first+n-1][0];
+
+    //The first time step of the series is the initial state
+    return continued ? n : n - 1;
 }
 
 
-void hbv_model::readData(string filename){
+void hbv_model::readData(string filename, int chunkSteps){
 
     ifstream in;
     string sJunk = "";
@@ -461,11 +576,84 @@ void hbv_model::readData(string filename){
     //Return to the beginning of the file
     in.seekg(0, ios::beg);
 
+    //Optional time step in hours (daily if not specified): sub-daily data have an hour column
+    tst = 24*3600;
+    if (findKey(in, "<TIME_STEP>"))
+    {
+        in >> dTemp;
+        tst = dTemp*3600.0;
+    }
+    if (tst <= 0.0 || tst > 24*3600 || fmod(24*3600, tst) != 0.0)
+    {
+        cout << "The time step must be a divisor of 24 hours" << endl;
+        exit(1);
+    }
+
+    //Optional elevation zones: lumped model (one zone with the whole area) if not specified
+    data.nZones = 1;
+    data.tempElev = 0.0;
+    data.lapseRate = 0.0;
+    if (findKey(in, "<ELEVATION_ZONES>")) in >> data.nZones;
+    if (data.nZones < 1)
+    {
+        cout << "The number of elevation zones must be at least 1" << endl;
+        exit(1);
+    }
+    data.zoneArea = new double[data.nZones];
+    data.zoneElev = new double[data.nZones];
+    data.zoneDeltaT = new double[data.nZones];
+    for (int z=0; z<data.nZones; z++)
+    {
+        data.zoneArea[z] = 1.0/data.nZones;
+        data.zoneElev[z] = 0.0;
+    }
+    if (findKey(in, "<ZONE_AREA>"))
+    {
+        for (int z=0; z<data.nZones; z++) in >> data.zoneArea[z];
+    }
+    double areaSum = 0.0;
+    for (int z=0; z<data.nZones; z++)
+    {
+        if (!(data.zoneArea[z] >= 0.0))
+        {
+            cout << "The zone areas must be non-negative fractions of the basin area" << endl;
+            exit(1);
+        }
+        areaSum += data.zoneArea[z];
+    }
+    if (fabs(areaSum - 1.0) > 1.0e-3)
+    {
+        cout << "The zone areas must be fractions of the basin area summing to 1 (sum: " << areaSum << ")" << endl;
+        exit(1);
+    }
+    if (findKey(in, "<ZONE_ELEVATION>"))
+    {
+        for (int z=0; z<data.nZones; z++) in >> data.zoneElev[z];
+    }
+    if (findKey(in, "<TEMP_ELEVATION>")) in >> data.tempElev;
+    if (findKey(in, "<LAPSE_RATE>")) in >> data.lapseRate;
+    for (int z=0; z<data.nZones; z++)
+    {
+        data.zoneDeltaT[z] = data.nZones > 1 ? data.lapseRate*(data.zoneElev[z] - data.tempElev) : 0.0;
+    }
+    in.clear();
+    in.seekg(0, ios::beg);
+
+    //Streaming: the data are read later, chunk by chunk (see loadForcing)
+    streamFirst = startingIndex;
+    streamSteps = data.nDays - startingIndex;
+    if (chunkSteps > 0)
+    {
+        data.nDays = chunkSteps + 1;
+        startingIndex = 0;
+    }
+
     //Allocate the arrays
     hbv_allocate(data.nDays);
 
     data.date = new int* [data.nDays];
-    for (int i=0; i<data.nDays; i++) data.date[i] = new int[3];
+    data.date[0] = new int[4*data.nDays];
+    for (int i=0; i<data.nDays; i++) data.date[i] = data.date[0] + 4*i;
     data.precip   = new double[data.nDays];
     data.evap     = new double[data.nDays];
     data.flow     = new double[data.nDays];
@@ -475,6 +663,11 @@ void hbv_model::readData(string filename){
         data.minTemp  = new double[data.nDays];
     }
     data.avgTemp  = new double[data.nDays];
+    if (chunkSteps > 0)
+    {
+        in.close();
+        return;
+    }
 
 
     //Look for the <DATA_START> key
@@ -493,6 +686,11 @@ void hbv_model::readData(string filename){
         data.date[i][1] = int(dTemp);
         in >> dTemp;
         data.date[i][2] = int(dTemp);
+        data.date[i][3] = 0;
+        if(tst < 24*3600){ // hour of the time step
+            in >> dTemp;
+            data.date[i][3] = int(dTemp);
+        }
         if(data.tempData > 1){ // max and min temperatures
             in >> data.precip[i] >> data.flow[i] >> data.maxTemp[i] >> data.minTemp[i];
             data.avgTemp[i] = (data.maxTemp[i] + data.minTemp[i])/2.0;
@@ -511,38 +709,104 @@ void hbv_model::readData(string filename){
 }
 
 
-void hbv_model::calculateHamonPE(int dataIndex, int nDays, int startDay){
+bool hbv_model::findKey(ifstream &in, string key){
+
+    string sJunk = "";
+
+    //Look for an optional key in the header (before <DATA_START>)
+    in.clear();
+    in.seekg(0, ios::beg);
+    while (in >> sJunk)
+    {
+        if (sJunk == key) return true;
+        if (sJunk == "<DATA_START>") break;
+    }
+    //Not found: return to the beginning of the file
+    in.clear();
+    in.seekg(0, ios::beg);
+    return false;
+}
+
+
+int hbv_model::calculateHamonPE(int dataIndex, int nDays, int startDay, double *PE, const double *tempDelta){
 
     int oldYear;
     int counter;
-
-    //Allocate
-    evap.PE        = new double [nDays];
+    int nZones = data.nZones;
+    double stepHours = tst/3600.0;
+    double temp, sunrise, wsum;
+    int first, last;
+    double *weight = new double [int(24.0/stepHours)];
 
     //Initialize the starting year
     oldYear = data.date[dataIndex][0];
     counter = startDay-1;
 
-    //Fill out each of the arrays
-    for (int i=0; i<nDays; i++)
+    //Fill out each of the arrays, one day at a time (one or more time steps)
+    for (first=0; first<nDays; first=last)
     {
+        //Time steps of the same day
+        last = first+1;
+        while (last < nDays && last-first < int(24.0/stepHours) &&
+               data.date[dataIndex+last][2] == data.date[dataIndex+first][2] &&
+               data.date[dataIndex+last][1] == data.date[dataIndex+first][1]) last++;
 
         //If the years hasn't changed, increment counter
-        if (data.date[dataIndex+i][0] == oldYear) counter++;
+        if (data.date[dataIndex+first][0] == oldYear) counter++;
         //If it has changed, reset counter - this handles leap years
         else counter = 1;
 
         evap.day = counter;
 
+        //Scenario: only the days with a temperature change are computed
+        double delta = 0.0;
+        if (tempDelta != NULL)
+        {
+            delta = tempDelta[data.date[dataIndex+first][1]-1];
+            if (delta == 0.0)
+            {
+                oldYear = data.date[dataIndex+first][0];
+                continue;
+            }
+        }
+
         evap.P = asin(0.39795*cos(0.2163108 + 2.0 * atan(0.9671396*tan(0.00860*double(evap.day-186)))));
         evap.dayLength = 24.0 - (24.0/PI)*(acos((sin(0.8333*PI/180.0)+sin(data.gageLat*PI/180.0)*sin(evap.P))/(cos(data.gageLat*PI/180.0)*cos(evap.P))));
-        evap.eStar = 0.6108*exp((17.27*data.avgTemp[dataIndex+i])/(237.3+data.avgTemp[dataIndex+i]));
-        evap.PE[i] = (715.5*evap.dayLength*evap.eStar/24.0)/(data.avgTemp[dataIndex+i] + 273.2);
 
-        oldYear = data.date[dataIndex+i][0];
+        //Sub-daily steps: the daily PE is distributed over the daylight hours (sine profile
+        //centered at noon), or uniformly if no step is in daylight
+        sunrise = 12.0 - evap.dayLength/2.0;
+        wsum = 0.0;
+        for (int i=first; i<last; i++)
+        {
+            double hmid = data.date[dataIndex+i][3] + stepHours/2.0;
+            weight[i-first] = (last-first == 1) ? 1.0 : max(sin(PI*(hmid - sunrise)/evap.dayLength), 0.0);
+            if (hmid < sunrise || hmid > sunrise + evap.dayLength) weight[i-first] = 0.0;
+            wsum += weight[i-first];
+        }
+        for (int i=first; i<last; i++)
+        {
+            weight[i-first] = (wsum > 0.0) ? weight[i-first]/wsum : 1.0/(last-first);
+        }
+
+        //PE of each zone, with the zone temperature (daily mean of the time steps)
+        for (int z=0; z<nZones; z++)
+        {
+            temp = 0.0;
+            for (int i=first; i<last; i++) temp += data.avgTemp[dataIndex+i];
+            temp = temp/(last-first) + data.zoneDeltaT[z] + delta;
+            evap.eStar = 0.6108*exp((17.27*temp)/(237.3+temp));
+            for (int i=first; i<last; i++)
+            {
+                PE[i*nZones+z] = weight[i-first]*(715.5*evap.dayLength*evap.eStar/24.0)/(temp + 273.2);
+            }
+        }
+
+        oldYear = data.date[dataIndex+first][0];
     }
 
-    return;
+    delete[] weight;
+    return counter;
 }
 
 
@@ -553,3 +817,24 @@ MyData hbv_model::getData(){
 hbv_fluxes hbv_model::getFluxes(){
     return fluxes;
 }
+
+double hbv_model::getTimeStep(){
+    return tst;
+}
+
+int hbv_model::getStartingIndex(){
+    return startingIndex;
+}
+
+int hbv_model::getStreamFirst(){
+    return streamFirst;
+}
+
+int hbv_model::getStreamSteps(){
+    return streamSteps;
+}
+
+int hbv_model::getWarmup(){
+    // first year (366 days) of the simulation
+    return ROUNDINT(366*24*3600.0/tst);
+}
@@ -24,9 +24,14 @@ along with HBV.  If not, see <http://www.gnu.org/licenses/>.
 #include <iomanip>
 #include <math.h>
 #include <cstdlib>
+#include <vector>
+#include "hbv_fastmath.h"
 
 namespace std{
 
+class hbv_enkf;
+class hbv_forcing_source;
+
 #define ROUNDINT(x) int(x + 0.5)
 #define ROUNDDOUBLE(x) double(int(x + 0.5))
 
@@ -41,7 +46,7 @@ struct hbv_parameters
     double lp; // evap something or other (unitless)
     double fcap; // surface soil storage [mm]
     double beta; // surface storage exponent
-    int maxbas; // routing coeff [d]
+    int maxbas; // routing coeff [time steps]
     double ttlim; // (TTH, degC)
     double degd; // (DDF - mm/(degC-D))
     double degw; // (TB, degC)
@@ -49,13 +54,59 @@ struct hbv_parameters
 
 struct hbv_states
 {
-    double *sowat; //[20][200]; //Soil water storate
-    double *sdep; //[20][200]; //Snow store
+    double *sowat; //[nDays][nZones]; //Soil water storate
+    double *sdep; //[nDays][nZones]; //Snow store
     double *ldep; //Depth of liquid in snow store
     double *stw1; //[20]; soil storage - shallow layer
     double *stw2; //[20]; soil storage - deep layer
 };
 
+/**
+ * state of the model at the end of a time step, from which a run can be
+ * continued (snow and soil of each zone, reservoirs and routing buffer)
+ */
+struct hbv_snapshot
+{
+    int day;                    // last simulated time step
+    vector<double> sowat;       // [nZones]
+    vector<double> sdep;        // [nZones]
+    double stw1;
+    double stw2;
+    vector<double> Qrouting;    // routing buffer, starting from the current time step
+};
+
+/**
+ * view of the current time step passed to the hooks of hbv_model::run:
+ * the states and fluxes can be modified by the hook (e.g. withdrawals from
+ * the soil or the upper reservoir), and the run continues from them
+ */
+struct hbv_step
+{
+    int day;                // time step
+    const int *date;        // year, month, day, hour
+    double precip;          // forcing of the time step
+    double temp;
+    int nZones;
+    const double *zoneArea; // fraction of the basin area of each zone
+    double *sowat;          // soil moisture of each zone (mm)
+    double *sdep;           // snow of each zone (mm)
+    double *stw1;           // upper reservoir (mm)
+    double *stw2;           // lower reservoir (mm, starts from zero at each time step)
+    double *Qsim;           // routed outflow of the time step (mm)
+    double *actualET;       // actual ET of the time step (mm)
+};
+
+/**
+ * climate scenario: delta changes of the forcing of each calendar month
+ * (precipitation multiplied by precipFactor, tempDelta added to the
+ * temperature), applied on the fly to the shared input data
+ */
+struct hbv_scenario
+{
+    double precipFactor[12];
+    double tempDelta[12];
+};
+
 struct hbv_fluxes
 {
     double *Qrouting; // Maxbas - routing Q's 
@@ -70,7 +121,7 @@ struct HamonEvap
     double P;
     double dayLength;
     double eStar;
-    double *PE;
+    double *PE;     //[nDays][nZones]
 };
 
 struct MyData
@@ -79,15 +130,23 @@ struct MyData
     double gageLat;     // latitude (decimal degrees)
     double gageLong;    // longitude (decimal degrees)
     double DA;          // drainage area
-    int nDays;          // Number of days of data
+    int nDays;          // Number of time steps of data (days, unless sub-daily)
     int tempData;       // Type of temperature data (1=daily average, 2=min and max)
 
+    //Elevation/land-use zones (optional, 1 zone = lumped model)
+    int nZones;         // Number of zones
+    double *zoneArea;   // Fraction of the basin area of each zone
+    double *zoneElev;   // Mean elevation of each zone (m)
+    double tempElev;    // Elevation of the temperature data (m)
+    double lapseRate;   // Temperature lapse rate (Celsius/m)
+    double *zoneDeltaT; // Temperature correction of each zone (Celsius)
+
     //Starting and ending dates of data to read
     int *dateStart;
     int *dateEnd;
 
 
-    int **date;         //Date of data [year, month, day]
+    int **date;         //Date of data [year, month, day, hour]
     double *precip;     //Mean areal precipitation (mm)
     double *evap;       //Climatic potential evaporation (mm)
     double *flow;       //Streamflow discharge (mm)
@@ -112,6 +171,29 @@ public:
      */
     hbv_model(string dataFile);
 
+    /**
+     * hbv_model constructor sharing the input data (and PE) of an existing
+     * model, with its own states and fluxes (e.g. one instance per thread)
+     */
+    hbv_model(hbv_model *base);
+
+    /**
+     * hbv_model constructor sharing the input data of an existing model
+     * under a climate scenario: precipitation and temperature are
+     * transformed when read, and PE is recomputed only for the months with
+     * a temperature change (otherwise the PE of base is shared). Copies of
+     * this model (threads) share the scenario and its PE.
+     */
+    hbv_model(hbv_model *base, const hbv_scenario &scenario);
+
+    /**
+     * hbv_model constructor for long series streamed chunk by chunk: only
+     * the header of the data file (site, zones, time step) is read, and the
+     * input data arrays hold chunkSteps time steps (plus the last one of the
+     * previous chunk). The states are kept for the current time step only.
+     */
+    hbv_model(string dataFile, int chunkSteps);
+
     /**
      * clear hbv_model structures
      */
@@ -122,14 +204,79 @@ public:
      */
     void calc_HBV(double *parameters);
 
+    /**
+     * evaluation split in parts: start() sets the parameters and the initial
+     * states, run() simulates the time steps [firstDay, lastDay) continuing
+     * from the last simulated one. calc_HBV is start() and run(1, nDays).
+     */
+    void start(double *parameters);
+    void run(int firstDay, int lastDay);
+
+    /**
+     * same runs, calling hook(hbv_step &s) at the end of each time step
+     * (coupled models, e.g. reservoir operation or water demands). The hook
+     * is a template parameter, so that a function object is inlined in the
+     * loop; runs without hook do not pay for it. Function objects and
+     * lambdas are accepted as lvalues or temporaries:
+     *   model.calc_HBV(p, [demand](hbv_step &s){ *s.stw1 -= min(*s.stw1, demand); });
+     */
+    template<class Hook> void run(int firstDay, int lastDay, Hook &&hook);
+    template<class Hook> void calc_HBV(double *parameters, Hook &&hook);
+
+    /**
+     * save the state at the end of the last simulated time step, or continue
+     * from a saved one (after start() with the same parameters)
+     */
+    void saveState(hbv_snapshot &s);
+    void loadState(const hbv_snapshot &s);
+
+    /**
+     * streaming: read the next chunk of forcing from the source and compute
+     * its PE. Returns the number of time steps to be simulated with
+     * run(1, n+1), 0 at the end of the series. For the next chunks
+     * (continued), the state of the last time step is saved before and
+     * loaded back (at day 0) after the call:
+     *   start(p); n = loadForcing(src, false);
+     *   while(n > 0){ run(1, n+1); saveState(s); n = loadForcing(src, true); s.day = 0; loadState(s); }
+     */
+    int loadForcing(hbv_forcing_source &source, bool continued);
+
     /**
       * get-functions for protected data
       **/
     MyData getData();
     hbv_fluxes getFluxes();
+    double getTimeStep();
+    int getWarmup();    // number of warm-up time steps (first year)
+    int getStartingIndex(); // index in the input data of the first time step
+    int getStreamFirst();   // data line of the first time step (streaming)
+    int getStreamSteps();   // time steps of the data file from the first one (streaming)
+
+    /**
+      * store the states of every time step (default) or only of the current
+      * one, which keeps the memory independent of the length of the run
+      **/
+    void setStoreStates(bool store);
+
+    /**
+      * compute the soil moisture term (SM/FC)^BETA with hbv_pow (see
+      * hbv_fastmath.h, relative error below 2e-13) instead of pow; copies
+      * of the model (threads) inherit the setting
+      **/
+    void setFastPow(bool fast);
+
+    /**
+      * number of parameters and their ranges (same as in CalHBV.java)
+      **/
+    static const int nParams = 12;
+    static const double paramMin[nParams];
+    static const double paramMax[nParams];
 
 protected:
 
+    // the ensemble filter runs the same processes on its own states
+    friend class hbv_enkf;
+
     /**
      * Initialization of HBV model:
      *  - allocation structures
@@ -139,8 +286,10 @@ protected:
      *  - re-initialization to zero
      */
     void hbv_allocate(int nDays);
-    void readData(string filename);
-    void calculateHamonPE(int dataIndex, int nDays, int startDay);
+    void allocateStates(int nDays);
+    void readData(string filename, int chunkSteps);
+    bool findKey(ifstream &in, string key);
+    int calculateHamonPE(int dataIndex, int nDays, int startDay, double *PE, const double *tempDelta);
     void setParameters(double* parameters);
     void reinitStateFluxes();
 
@@ -148,10 +297,11 @@ protected:
     /**
      * rainfall-runoff processes
      */
-    // Effective precipitation
-    double snow(int modelDay);
-    // Soil moisture
-    void soil(double eff_precip, int modelDay);
+    // Effective precipitation (of each zone)
+    void snow(int modelDay, double *eff_precip);
+    // Soil moisture (zones are aggregated into the shallow layer)
+    void soil(const double *eff_precip, int modelDay);
+    template<bool fast> void soilZones(const double *eff_precip, int modelDay);
     // Basin discharge
     double discharge(int modelDay);
     // Discharge routing
@@ -159,12 +309,38 @@ protected:
     // Routing update/reinitialization
     void backflow();
     void reinitForMaxBas();
+    // Processes of one zone and of the reservoirs in a time step, shared
+    // with the ensemble filter (which runs them for each member)
+    static inline void snowZone(double temp, double precip, double sdep_old, const hbv_parameters &p,
+                                double &sdep, double &eff_precip);
+    template<bool fast> static inline void soilZone(double sowat_old, double eff_precip, double PE,
+                                const hbv_parameters &p, double &sowat, double &runoff, double &et);
+    static inline double reservoirs(double &stw1, double &stw2, const hbv_parameters &p);
+    // Forcing of a data time step (under the scenario, if any)
+    inline void forcing(int i, double &precip, double &temp);
+    // One time step of all the processes (inlined in the loops of run)
+    inline void step(int day);
 
 
 
     int dayStartIndex;
     int startingIndex;
     double tst; // time-step
+    bool sharedData; // data and PE belong to another instance
+    bool storeStates; // states of every time step or of today and yesterday only
+    bool fastPow; // approximate power in the soil routine
+    double *routingWeights; // triangular transformation function of MAXBAS
+    int routingHead; // first element of the circular buffer Qrouting
+    int currentDay; // last simulated time step
+    int streamFirst, streamSteps; // first time step and time steps of the data file
+    int streamYear, streamDay; // year and day of the year of the last streamed time step
+    hbv_scenario *scenario; // climate scenario (NULL = forcing as read)
+    bool ownScenario; // the scenario and its PE belong to this instance
+    double *scenarioPE; // PE under the scenario (NULL = PE of the data)
+
+    // index of the states of a time step
+    int slot(int modelDay) { return storeStates ? modelDay : (modelDay & 1); }
+    double *zoneWork; // effective precipitation of each zone
 
     MyData data;
     HamonEvap evap;
@@ -173,6 +349,148 @@ protected:
     hbv_fluxes fluxes;
 
 };
+
+
+inline void hbv_model::snowZone(double temp, double precip, double sdep_old, const hbv_parameters &p,
+                                double &sdep, double &eff_precip)
+{
+    // Snow/Rain: if temperature is lower than threshold (ttlim) --> precip is all snow,
+    // otherwise --> add precip to effective precip
+    bool snowfall = temp < p.ttlim;
+    double sd = snowfall ? sdep_old + precip : sdep_old;
+    double eff = snowfall ? 0.0 : precip;
+
+    // Snow melt if temperature > threshold (degw) and there is actually snow to melt:
+    // degree-day factor (degd), but no more than what is actually stored
+    double smelt = (temp > p.degw && sd > 0.0) ? min((temp - p.degw)*p.degd, sd) : 0.0;
+
+    eff_precip = eff + smelt;   //effective precip is precip together with what acutally melted
+    sdep = sd - smelt;          //Remove the amount that melted from the snow store
+}
+
+
+template<bool fast> inline void hbv_model::soilZone(double sowat_old, double eff_precip, double PE,
+                                const hbv_parameters &p, double &sowat, double &runoff, double &et)
+{
+    double fcap = p.fcap;
+
+    //If the soil moisture storage is already at capacity, runoff = all precip + excess
+    //otherwise this is the portion of the effective precip that goes into storage
+    bool full = sowat_old >= fcap;
+    double hsw = full ? 0.0 : eff_precip * (1.0 - (fast ? hbv_pow(sowat_old/fcap, p.beta) : pow((sowat_old/fcap), p.beta)));
+    double sw = full ? fcap : sowat_old + hsw;
+    runoff = full ? eff_precip + (sowat_old - fcap) : eff_precip - hsw;
+
+    //If the amount going into the soil moisture storage will result in exceeding the capacity of the store...
+    runoff = (sw > fcap) ? runoff + (sw - fcap) : runoff;
+    sw = min(sw, fcap); //We are at capacity
+
+    double AET = PE*min(sowat_old/(fcap*p.lp), 1.0); // actual ET, after adjusting for saturation in soil layer
+    AET = max(AET, 0.0);
+
+    //If there is enough in the soil moisture store to supply the AET, subtract it, otherwise all of it evaporates
+    et = (sw > AET) ? AET : sw;
+    sowat = (sw > AET) ? sw - AET : 0.0;
+}
+
+
+inline double hbv_model::reservoirs(double &stw1, double &stw2, const hbv_parameters &p)
+{
+    //If the upper reservoir water level is above the threshold for near surface flow,
+    //calculate it, and remove it from the reservoir
+    double Q0 = stw1 > p.hl1 ? (stw1 - p.hl1)*p.ck0 : 0.0;
+    stw1 -= Q0;
+
+    //If there is still water left in the upper reservoir, calculate what now goes into interflow, and remove it
+    double Q1 = stw1 > 0.0 ? stw1*p.ck1 : 0.0;
+    stw1 -= Q1;
+
+    //If there is still enough water in the upper reservoir to completely supply percolation,
+    //move the amount from the upper to the lower reservoir, otherwise we just put what we can
+    bool perc = stw1 > p.perc;
+    stw2 += perc ? p.perc : stw1;
+    stw1 = perc ? stw1 - p.perc : 0.0;
+
+    //If there is water in the lower reservoir, calculate base flow, and remove it
+    double Q2 = stw2 > 0.0 ? stw2*p.ck2 : 0.0;
+    stw2 -= Q2;
+
+    return (Q0 + Q1 + Q2); // total dischargearge - mm per timestep
+}
+
+
+inline void hbv_model::forcing(int i, double &precip, double &temp)
+{
+    precip = data.precip[i];
+    temp = data.avgTemp[i];
+    if (scenario != NULL)
+    {
+        int m = data.date[i][1] - 1;
+        precip *= scenario->precipFactor[m];
+        temp += scenario->tempDelta[m];
+    }
+}
+
+
+inline void hbv_model::step(int day)
+{
+    // Now run the components of the model
+    double Qall;
+    double *eff_precip = zoneWork;
+
+    //The reservoirs of today start from zero (yesterday's storage is added in soil())
+    states.stw1[slot(day)] = 0.0;
+    states.stw2[slot(day)] = 0.0;
+
+    //Degree-day snow module (sets eff_precip value of each zone)
+    snow(day, eff_precip);
+
+    //Soil/ET module (sets runoff_depth value)
+    soil(eff_precip, day);
+
+    // Calculate the resulting dischargearge Qall
+    Qall = discharge(day);
+
+    // Route Qall using MaxBas routing
+    routing(Qall, day);
+
+    // Shift the routing arrays to the next timestep
+    backflow();
+
+    return;
+}
+
+
+template<class Hook> void hbv_model::run(int firstDay, int lastDay, Hook &&hook)
+{
+    hbv_step s;
+    s.nZones = data.nZones;
+    s.zoneArea = data.zoneArea;
+    for (int day = firstDay; day < lastDay; day++)
+    {
+        step(day);
+
+        int t = slot(day);
+        s.day = day;
+        s.date = data.date[startingIndex + day];
+        forcing(startingIndex + day, s.precip, s.temp);
+        s.sowat = &states.sowat[t*data.nZones];
+        s.sdep = &states.sdep[t*data.nZones];
+        s.stw1 = &states.stw1[t];
+        s.stw2 = &states.stw2[t];
+        s.Qsim = &fluxes.Qsim[day];
+        s.actualET = &fluxes.actualET[day];
+        hook(s);
+    }
+    if (lastDay > firstDay) currentDay = lastDay - 1;
+}
+
+
+template<class Hook> void hbv_model::calc_HBV(double *parameters, Hook &&hook)
+{
+    start(parameters);
+    run(1, data.nDays, hook);
+}
 }
 
 #endif
@@ -0,0 +1,487 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_moea.h"
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <cstdio>
+#include <limits>
+
+using namespace std;
+
+hbv_moea::hbv_moea(int nvars, const double *lb, const double *ub, moea_settings &settings)
+{
+    this->nvars = nvars;
+    this->lb.assign(lb, lb+nvars);
+    this->ub.assign(ub, ub+nvars);
+    this->settings = settings;
+    nobjs = 0;
+    nfe = 0;
+    generation = 0;
+    rng.seed(settings.seed);
+    surrogate = NULL;
+    screened = rejected = controlFlagged = controlImproved = 0;
+}
+
+hbv_moea::~hbv_moea()
+{
+    delete surrogate;
+}
+
+vector<moea_solution> hbv_moea::getArchive()
+{
+    return archive;
+}
+
+int hbv_moea::getNFE()
+{
+    return nfe;
+}
+
+
+void hbv_moea::run(hbv_evaluator &evaluator)
+{
+    nobjs = evaluator.getNumberOfObjectives();
+    // a single epsilon is used for all the objectives
+    if(settings.eps.size() < (unsigned int)nobjs){
+        settings.eps.resize(nobjs, settings.eps.empty() ? 0.01 : settings.eps.back());
+    }
+
+    if(settings.surrogateSize > 0){
+        surrogate = new hbv_surrogate(nvars, nobjs, &lb[0], &ub[0], settings.surrogateSize);
+    }
+
+    if(!settings.resumeFile.empty()){
+        loadCheckpoint(settings.resumeFile);
+        // the surrogate restarts from the solutions in the checkpoint
+        if(surrogate != NULL){
+            for(unsigned int i=0; i<population.size(); i++) surrogate->add(&population[i].vars[0], &population[i].objs[0]);
+            for(unsigned int i=0; i<archive.size(); i++) surrogate->add(&archive[i].vars[0], &archive[i].objs[0]);
+        }
+    }else{
+        initPopulation();
+        evaluateBatch(population, evaluator);
+        nonDominatedSort(population);
+    }
+
+    while(nfe < settings.maxNFE){
+        vector<moea_solution> offspring = makeOffspring();
+        if(surrogate != NULL){
+            vector<bool> flagged, accepted;
+            screen(offspring, flagged);
+            evaluateBatch(offspring, evaluator, &accepted);
+            for(unsigned int i=0; i<offspring.size(); i++){
+                if(flagged[i]) controlFlagged++;
+                if(flagged[i] && accepted[i]) controlImproved++;
+            }
+        }else{
+            evaluateBatch(offspring, evaluator);
+        }
+
+        // (mu + lambda) survival
+        population.insert(population.end(), offspring.begin(), offspring.end());
+        nonDominatedSort(population);
+        truncate(population);
+        generation++;
+
+        if(!settings.checkpointFile.empty() && settings.checkpointFreq > 0 &&
+                generation % settings.checkpointFreq == 0){
+            saveCheckpoint(settings.checkpointFile);
+        }
+    }
+
+    if(!settings.checkpointFile.empty()){
+        saveCheckpoint(settings.checkpointFile);
+    }
+}
+
+
+void hbv_moea::evaluateBatch(vector<moea_solution> &sol, hbv_evaluator &evaluator, vector<bool> *accepted)
+{
+    int n = sol.size();
+    vector<double> vars(n*nvars);
+    vector<double> objs(n*nobjs);
+    for(int i=0; i<n; i++){
+        copy(sol[i].vars.begin(), sol[i].vars.end(), vars.begin()+i*nvars);
+    }
+
+    evaluator.evaluate(n, &vars[0], &objs[0]);
+
+    for(int i=0; i<n; i++){
+        sol[i].objs.assign(objs.begin()+i*nobjs, objs.begin()+(i+1)*nobjs);
+        // failed simulations (NaN) are never accepted
+        for(int j=0; j<nobjs; j++){
+            if(sol[i].objs[j] != sol[i].objs[j]) sol[i].objs[j] = numeric_limits<double>::max();
+        }
+        bool added = addToArchive(sol[i]);
+        if(accepted != NULL) accepted->push_back(added);
+        if(surrogate != NULL) surrogate->add(&sol[i].vars[0], &sol[i].objs[0]);
+    }
+    nfe += n;
+}
+
+
+void hbv_moea::screen(vector<moea_solution> &offspring, vector<bool> &flagged)
+{
+    flagged.assign(offspring.size(), false);
+    if(!surrogate->train()) return;
+
+    // random control sample, always simulated (at least one solution, so that the run progresses)
+    uniform_real_distribution<double> U(0.0, 1.0);
+    vector<bool> exact(offspring.size());
+    bool any = false;
+    for(unsigned int i=0; i<offspring.size(); i++){
+        exact[i] = U(rng) < settings.exactFraction;
+        any = any || exact[i];
+    }
+    if(!any) exact[0] = true;
+
+    vector<moea_solution> kept;
+    vector<bool> keptFlags;
+    vector<double> pred(nobjs);
+    for(unsigned int i=0; i<offspring.size(); i++){
+        surrogate->predict(&offspring[i].vars[0], &pred[0]);
+        screened++;
+        bool dominated = false;
+        for(unsigned int k=0; k<archive.size() && !dominated; k++){
+            dominated = dominance(archive[k].objs, pred) < 0;
+        }
+        if(dominated && !exact[i]){
+            rejected++;
+            continue;
+        }
+        kept.push_back(offspring[i]);
+        keptFlags.push_back(dominated);
+    }
+    offspring.swap(kept);
+    flagged.swap(keptFlags);
+}
+
+
+void hbv_moea::printSurrogateStatistics(ostream &out)
+{
+    if(surrogate == NULL) return;
+    out << "surrogate: " << screened << " offspring screened, " << rejected << " discarded without simulation ("
+        << (screened > 0 ? 100.0*rejected/screened : 0.0) << "%), " << nfe << " simulated" << endl;
+    out << "surrogate: " << controlFlagged << " simulated offspring would have been discarded, "
+        << controlImproved << " of them entered the archive ("
+        << (controlFlagged > 0 ? 100.0*controlImproved/controlFlagged : 0.0) << "% false rejections)" << endl;
+}
+
+
+void hbv_moea::initPopulation()
+{
+    uniform_real_distribution<double> U(0.0, 1.0);
+    population.resize(settings.popSize);
+    for(int i=0; i<settings.popSize; i++){
+        population[i].vars.resize(nvars);
+        for(int j=0; j<nvars; j++){
+            population[i].vars[j] = lb[j] + U(rng)*(ub[j]-lb[j]);
+        }
+    }
+}
+
+
+int hbv_moea::tournament()
+{
+    // binary tournament on rank and crowding distance
+    uniform_int_distribution<int> pick(0, population.size()-1);
+    int a = pick(rng);
+    int b = pick(rng);
+    if(population[a].rank != population[b].rank){
+        return population[a].rank < population[b].rank ? a : b;
+    }
+    return population[a].crowding > population[b].crowding ? a : b;
+}
+
+
+void hbv_moea::sbx(moea_solution &p1, moea_solution &p2, moea_solution &c1, moea_solution &c2)
+{
+    uniform_real_distribution<double> U(0.0, 1.0);
+    c1.vars = p1.vars;
+    c2.vars = p2.vars;
+    if(U(rng) > settings.pc) return;
+
+    // simulated binary crossover with bounds (Deb and Agrawal, 1995)
+    double eta = settings.etaC;
+    for(int j=0; j<nvars; j++){
+        if(U(rng) > 0.5) continue;
+        double x1 = min(p1.vars[j], p2.vars[j]);
+        double x2 = max(p1.vars[j], p2.vars[j]);
+        if(x2 - x1 < 1.0e-14) continue;
+
+        double u = U(rng);
+        double beta = 1.0 + 2.0*(x1 - lb[j])/(x2 - x1);
+        double alpha = 2.0 - pow(beta, -(eta + 1.0));
+        double betaq = (u <= 1.0/alpha) ? pow(u*alpha, 1.0/(eta + 1.0)) : pow(1.0/(2.0 - u*alpha), 1.0/(eta + 1.0));
+        double y1 = 0.5*((x1 + x2) - betaq*(x2 - x1));
+
+        beta = 1.0 + 2.0*(ub[j] - x2)/(x2 - x1);
+        alpha = 2.0 - pow(beta, -(eta + 1.0));
+        betaq = (u <= 1.0/alpha) ? pow(u*alpha, 1.0/(eta + 1.0)) : pow(1.0/(2.0 - u*alpha), 1.0/(eta + 1.0));
+        double y2 = 0.5*((x1 + x2) + betaq*(x2 - x1));
+
+        y1 = min(max(y1, lb[j]), ub[j]);
+        y2 = min(max(y2, lb[j]), ub[j]);
+        if(U(rng) < 0.5) swap(y1, y2);
+        c1.vars[j] = y1;
+        c2.vars[j] = y2;
+    }
+}
+
+
+void hbv_moea::mutation(moea_solution &s)
+{
+    // polynomial mutation with probability 1/nvars
+    uniform_real_distribution<double> U(0.0, 1.0);
+    double eta = settings.etaM;
+    for(int j=0; j<nvars; j++){
+        if(U(rng) >= 1.0/nvars) continue;
+        double x = s.vars[j];
+        double d1 = (x - lb[j])/(ub[j] - lb[j]);
+        double d2 = (ub[j] - x)/(ub[j] - lb[j]);
+        double u = U(rng);
+        double dq;
+        if(u < 0.5){
+            dq = pow(2.0*u + (1.0 - 2.0*u)*pow(1.0 - d1, eta + 1.0), 1.0/(eta + 1.0)) - 1.0;
+        }else{
+            dq = 1.0 - pow(2.0*(1.0 - u) + 2.0*(u - 0.5)*pow(1.0 - d2, eta + 1.0), 1.0/(eta + 1.0));
+        }
+        s.vars[j] = min(max(x + dq*(ub[j] - lb[j]), lb[j]), ub[j]);
+    }
+}
+
+
+vector<moea_solution> hbv_moea::makeOffspring()
+{
+    vector<moea_solution> offspring;
+    while((int)offspring.size() < settings.popSize){
+        moea_solution c1, c2;
+        sbx(population[tournament()], population[tournament()], c1, c2);
+        mutation(c1);
+        mutation(c2);
+        offspring.push_back(c1);
+        if((int)offspring.size() < settings.popSize) offspring.push_back(c2);
+    }
+    return offspring;
+}
+
+
+int hbv_moea::dominance(const vector<double> &a, const vector<double> &b)
+{
+    // -1 if a dominates b, 1 if b dominates a, 0 otherwise
+    bool aBetter = false, bBetter = false;
+    for(unsigned int i=0; i<a.size(); i++){
+        if(a[i] < b[i]) aBetter = true;
+        else if(b[i] < a[i]) bBetter = true;
+    }
+    if(aBetter && !bBetter) return -1;
+    if(bBetter && !aBetter) return 1;
+    return 0;
+}
+
+
+void hbv_moea::nonDominatedSort(vector<moea_solution> &sol)
+{
+    // fast non-dominated sorting (Deb et al., 2002)
+    int n = sol.size();
+    vector<vector<int> > dominated(n);
+    vector<int> count(n, 0);
+    vector<int> front;
+
+    for(int i=0; i<n; i++){
+        for(int j=i+1; j<n; j++){
+            int d = dominance(sol[i].objs, sol[j].objs);
+            if(d < 0){
+                dominated[i].push_back(j);
+                count[j]++;
+            }else if(d > 0){
+                dominated[j].push_back(i);
+                count[i]++;
+            }
+        }
+    }
+    for(int i=0; i<n; i++){
+        if(count[i] == 0){
+            sol[i].rank = 0;
+            front.push_back(i);
+        }
+    }
+
+    int rank = 0;
+    while(!front.empty()){
+        crowdingDistance(sol, front);
+        vector<int> next;
+        for(unsigned int k=0; k<front.size(); k++){
+            int i = front[k];
+            for(unsigned int m=0; m<dominated[i].size(); m++){
+                int j = dominated[i][m];
+                if(--count[j] == 0){
+                    sol[j].rank = rank+1;
+                    next.push_back(j);
+                }
+            }
+        }
+        front = next;
+        rank++;
+    }
+}
+
+
+void hbv_moea::crowdingDistance(vector<moea_solution> &sol, vector<int> &front)
+{
+    int n = front.size();
+    for(int k=0; k<n; k++) sol[front[k]].crowding = 0.0;
+    if(n < 3){
+        for(int k=0; k<n; k++) sol[front[k]].crowding = numeric_limits<double>::max();
+        return;
+    }
+
+    vector<int> idx(front);
+    for(int m=0; m<nobjs; m++){
+        sort(idx.begin(), idx.end(), [&sol, m](int a, int b){ return sol[a].objs[m] < sol[b].objs[m]; });
+        double fmin = sol[idx[0]].objs[m];
+        double fmax = sol[idx[n-1]].objs[m];
+        sol[idx[0]].crowding = numeric_limits<double>::max();
+        sol[idx[n-1]].crowding = numeric_limits<double>::max();
+        if(fmax - fmin <= 0.0) continue;
+        for(int k=1; k<n-1; k++){
+            if(sol[idx[k]].crowding < numeric_limits<double>::max()){
+                sol[idx[k]].crowding += (sol[idx[k+1]].objs[m] - sol[idx[k-1]].objs[m])/(fmax - fmin);
+            }
+        }
+    }
+}
+
+
+void hbv_moea::truncate(vector<moea_solution> &sol)
+{
+    // keep the best popSize solutions by rank and crowding distance
+    sort(sol.begin(), sol.end(), [](const moea_solution &a, const moea_solution &b){
+        if(a.rank != b.rank) return a.rank < b.rank;
+        return a.crowding > b.crowding;
+    });
+    if((int)sol.size() > settings.popSize) sol.resize(settings.popSize);
+}
+
+
+bool hbv_moea::addToArchive(const moea_solution &s)
+{
+    vector<double> box(nobjs);
+    for(int m=0; m<nobjs; m++) box[m] = floor(s.objs[m]/settings.eps[m]);
+
+    unsigned int i = 0;
+    while(i < archive.size()){
+        vector<double> abox(nobjs);
+        for(int m=0; m<nobjs; m++) abox[m] = floor(archive[i].objs[m]/settings.eps[m]);
+
+        int d = dominance(box, abox);
+        if(d > 0) return false;                 // the archive box dominates the candidate
+        if(d < 0){                              // the candidate box dominates the archive one
+            archive.erase(archive.begin()+i);
+            continue;
+        }
+        if(box == abox){
+            // same box: keep the dominating solution or the one closer to the box corner
+            int ds = dominance(s.objs, archive[i].objs);
+            if(ds > 0) return false;
+            if(ds == 0){
+                double dist_s = 0.0, dist_a = 0.0;
+                for(int m=0; m<nobjs; m++){
+                    dist_s += pow(s.objs[m] - box[m]*settings.eps[m], 2);
+                    dist_a += pow(archive[i].objs[m] - box[m]*settings.eps[m], 2);
+                }
+                if(dist_a <= dist_s) return false;
+            }
+            archive[i] = s;
+            return true;
+        }
+        i++;
+    }
+    archive.push_back(s);
+    return true;
+}
+
+
+void hbv_moea::printArchive(ostream &out)
+{
+    out << setprecision(10);
+    for(unsigned int i=0; i<archive.size(); i++){
+        for(int j=0; j<nvars; j++) out << archive[i].vars[j] << " ";
+        for(int m=0; m<nobjs; m++) out << archive[i].objs[m] << (m < nobjs-1 ? " " : "");
+        out << endl;
+    }
+}
+
+
+void hbv_moea::saveCheckpoint(string filename)
+{
+    // write to a temporary file first so that a crash never leaves a broken checkpoint
+    string tmp = filename + ".tmp";
+    ofstream out(tmp.c_str(), ios::out);
+    out << setprecision(17);
+    out << "# hbv_moea checkpoint: nfe generation popSize archiveSize nvars nobjs, rng, population, archive" << endl;
+    out << nfe << " " << generation << " " << population.size() << " " << archive.size() << " " << nvars << " " << nobjs << endl;
+    out << rng << endl;
+    for(int set=0; set<2; set++){
+        vector<moea_solution> &sol = set == 0 ? population : archive;
+        for(unsigned int i=0; i<sol.size(); i++){
+            for(int j=0; j<nvars; j++) out << sol[i].vars[j] << " ";
+            for(int m=0; m<nobjs; m++) out << sol[i].objs[m] << " ";
+            out << endl;
+        }
+    }
+    out.close();
+    rename(tmp.c_str(), filename.c_str());
+}
+
+
+void hbv_moea::loadCheckpoint(string filename)
+{
+    ifstream in(filename.c_str(), ios::in);
+    if(!in){
+        cout << "The checkpoint file specified: " << filename << " could not be found!" << endl;
+        exit(1);
+    }
+    in.ignore(1000, '\n');
+
+    int popSize, archiveSize, nv, no;
+    in >> nfe >> generation >> popSize >> archiveSize >> nv >> no;
+    if(nv != nvars || no != nobjs){
+        cout << "The checkpoint " << filename << " does not match the problem (" << nv << " variables, " << no << " objectives)" << endl;
+        exit(1);
+    }
+    in >> rng;
+
+    population.resize(popSize);
+    archive.resize(archiveSize);
+    for(int set=0; set<2; set++){
+        vector<moea_solution> &sol = set == 0 ? population : archive;
+        for(unsigned int i=0; i<sol.size(); i++){
+            sol[i].vars.resize(nvars);
+            sol[i].objs.resize(nobjs);
+            for(int j=0; j<nvars; j++) in >> sol[i].vars[j];
+            for(int m=0; m<nobjs; m++) in >> sol[i].objs[m];
+        }
+    }
+    in.close();
+    nonDominatedSort(population);
+}
@@ -0,0 +1,144 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_MOEA_H
+#define HBV_MOEA_H
+
+#include "hbv_pool.h"
+#include "hbv_surrogate.h"
+#include <vector>
+#include <string>
+#include <random>
+
+namespace std{
+
+struct moea_solution
+{
+    vector<double> vars;
+    vector<double> objs;
+    int rank;           // non-domination rank
+    double crowding;    // crowding distance
+};
+
+struct moea_settings
+{
+    int popSize;            // population size (offspring per generation)
+    int maxNFE;             // number of function evaluations
+    unsigned int seed;      // random seed
+    vector<double> eps;     // epsilon of each objective (archive resolution)
+    double pc;              // SBX crossover probability
+    double etaC;            // SBX distribution index
+    double etaM;            // polynomial mutation distribution index
+    string checkpointFile;  // population checkpoint (empty = none)
+    int checkpointFreq;     // generations between two checkpoints
+    string resumeFile;      // checkpoint to restart from (empty = none)
+    int surrogateSize;      // points of the surrogate model (0 = no pre-screening)
+    double exactFraction;   // fraction of the screened offspring always simulated
+};
+
+/**
+ * Epsilon-dominance NSGA-II: the population evolves with NSGA-II (SBX,
+ * polynomial mutation, non-dominated sorting and crowding), each generation
+ * is evaluated as a batch and every evaluated solution is offered to an
+ * epsilon-box dominance archive (as in Borg/eps-NSGAII). All objectives are
+ * minimized.
+ * With a surrogate model, the offspring predicted to be dominated by the
+ * archive are discarded without simulation, except for a random fraction
+ * that is always simulated (which also measures how often the surrogate
+ * would have discarded a solution improving the archive). Only simulated
+ * solutions count as function evaluations.
+ */
+class hbv_moea
+{
+public:
+
+    hbv_moea(int nvars, const double *lb, const double *ub, moea_settings &settings);
+    virtual ~hbv_moea();
+
+    /**
+     * run the optimization until maxNFE evaluations are reached
+     */
+    void run(hbv_evaluator &evaluator);
+
+    /**
+     * current epsilon-non-dominated archive
+     */
+    vector<moea_solution> getArchive();
+    int getNFE();
+
+    /**
+     * print the archive as rows of variables and objectives
+     */
+    void printArchive(ostream &out);
+
+    /**
+     * print the statistics of the surrogate pre-screening
+     */
+    void printSurrogateStatistics(ostream &out);
+
+protected:
+
+    // evaluation of a set of solutions in one batch
+    void evaluateBatch(vector<moea_solution> &sol, hbv_evaluator &evaluator, vector<bool> *accepted = NULL);
+
+    // surrogate pre-screening: removes the offspring predicted to be useless
+    // and marks the simulated ones that the surrogate would have discarded
+    void screen(vector<moea_solution> &offspring, vector<bool> &flagged);
+
+    // variation operators
+    void initPopulation();
+    int tournament();
+    void sbx(moea_solution &p1, moea_solution &p2, moea_solution &c1, moea_solution &c2);
+    void mutation(moea_solution &s);
+    vector<moea_solution> makeOffspring();
+
+    // survival selection
+    static int dominance(const vector<double> &a, const vector<double> &b);
+    void nonDominatedSort(vector<moea_solution> &sol);
+    void crowdingDistance(vector<moea_solution> &sol, vector<int> &front);
+    void truncate(vector<moea_solution> &sol);
+
+    // epsilon-box dominance archive
+    bool addToArchive(const moea_solution &s);
+
+    // checkpoints
+    void saveCheckpoint(string filename);
+    void loadCheckpoint(string filename);
+
+    int nvars;
+    int nobjs;
+    vector<double> lb;
+    vector<double> ub;
+    moea_settings settings;
+
+    int nfe;
+    int generation;
+    mt19937 rng;
+    vector<moea_solution> population;
+    vector<moea_solution> archive;
+
+    hbv_surrogate *surrogate;
+    long screened;          // offspring predicted by the surrogate
+    long rejected;          // offspring discarded without simulation
+    long controlFlagged;    // simulated offspring that would have been discarded
+    long controlImproved;   // ... and entered the archive anyway
+
+};
+}
+
+#endif // HBV_MOEA_H
@@ -0,0 +1,207 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_monitor.h"
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+const double hbv_stats::buckets[hbv_stats::NBUCKETS] = {1.0e-4, 2.5e-4, 5.0e-4, 1.0e-3, 2.5e-3, 5.0e-3, 1.0e-2, 2.5e-2, 0.1, 0.5, 2.5, 10.0};
+bool hbv_stats::enabled = false;
+atomic<long> hbv_stats::evaluations(0);
+atomic<long> hbv_stats::aborted(0);
+atomic<long> hbv_stats::timeSteps(0);
+atomic<long> hbv_stats::cacheHits(0);
+atomic<long> hbv_stats::cacheMisses(0);
+atomic<long> hbv_stats::queueDepth(0);
+atomic<long> hbv_stats::latency[hbv_stats::NBUCKETS+1];
+atomic<long> hbv_stats::latencySum(0);
+
+void hbv_stats::evaluation(chrono::steady_clock::time_point t0, int nSteps)
+{
+    if(!enabled) return;
+    add(evaluations);
+    add(timeSteps, nSteps);
+    long ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - t0).count();
+    int b = 0;
+    while(b < NBUCKETS && ns > buckets[b]*1.0e9) b++;
+    add(latency[b]);
+    add(latencySum, ns);
+}
+
+
+hbv_monitor::hbv_monitor(string address)
+{
+    this->address = address;
+    for(int b=0; b<=hbv_stats::NBUCKETS; b++) hbv_stats::latency[b] = 0;
+    hbv_stats::enabled = true;
+
+    if(address.compare(0, 5, "unix:") == 0){
+        string path = address.substr(5);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path)-1);
+        unlink(path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) fd = -1;
+    }else{
+        // loopback interface only
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(atoi(address.c_str()));
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int one = 1;
+        if(fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        if(fd < 0 || bind(fd, (sockaddr*)&addr, sizeof(addr)) != 0) fd = -1;
+    }
+    if(fd < 0 || listen(fd, 8) != 0){
+        cout << "The monitor could not listen on " << address << " (PORT or unix:PATH)" << endl;
+        exit(1);
+    }
+
+    started = chrono::steady_clock::now();
+    stop = false;
+    server = thread(&hbv_monitor::serve, this);
+}
+
+hbv_monitor::~hbv_monitor()
+{
+    stop = true;
+    server.join();
+    close(fd);
+    if(address.compare(0, 5, "unix:") == 0) unlink(address.substr(5).c_str());
+    hbv_stats::enabled = false;
+}
+
+
+void hbv_monitor::serve()
+{
+    // the stop flag is checked between the connections
+    pollfd p;
+    p.fd = fd;
+    p.events = POLLIN;
+    while(!stop){
+        if(poll(&p, 1, 200) <= 0) continue;
+        int client = accept(fd, NULL, NULL);
+        if(client < 0) continue;
+        respond(client);
+        close(client);
+    }
+}
+
+
+void hbv_monitor::respond(int client)
+{
+    // request line and headers (up to an empty line), with a timeout
+    string request;
+    char buf[1024];
+    pollfd p;
+    p.fd = client;
+    p.events = POLLIN;
+    while(request.find("\r\n\r\n") == string::npos && request.find("\n\n") == string::npos && request.size() < 16384){
+        if(poll(&p, 1, 1000) <= 0) return;
+        ssize_t n = read(client, buf, sizeof(buf));
+        if(n <= 0) break;
+        request.append(buf, n);
+    }
+
+    string status, body;
+    if(request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 6, "GET / ") == 0){
+        status = "200 OK";
+        body = exposition();
+    }else{
+        status = "404 Not Found";
+        body = "only GET /metrics is served\n";
+    }
+    stringstream response;
+    response << "HTTP/1.0 " << status << "\r\n"
+             << "Content-Type: text/plain; version=0.0.4\r\n"
+             << "Content-Length: " << body.size() << "\r\n"
+             << "Connection: close\r\n\r\n" << body;
+    string r = response.str();
+    size_t sent = 0;
+    while(sent < r.size()){
+        ssize_t n = write(client, r.data()+sent, r.size()-sent);
+        if(n <= 0) break;
+        sent += n;
+    }
+}
+
+
+string hbv_monitor::exposition()
+{
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    long evaluations = hbv_stats::evaluations.load(memory_order_relaxed);
+
+    // resident set size
+    long pages = 0, rss = 0;
+    ifstream statm("/proc/self/statm");
+    if(statm >> pages >> rss) rss *= sysconf(_SC_PAGESIZE);
+
+    stringstream out;
+    out << "# HELP hbv_evaluations_total Completed model runs." << endl
+        << "# TYPE hbv_evaluations_total counter" << endl
+        << "hbv_evaluations_total " << evaluations << endl
+        << "# HELP hbv_aborted_evaluations_total Runs stopped before the end of the record (race)." << endl
+        << "# TYPE hbv_aborted_evaluations_total counter" << endl
+        << "hbv_aborted_evaluations_total " << hbv_stats::aborted.load(memory_order_relaxed) << endl
+        << "# HELP hbv_time_steps_total Simulated time steps." << endl
+        << "# TYPE hbv_time_steps_total counter" << endl
+        << "hbv_time_steps_total " << hbv_stats::timeSteps.load(memory_order_relaxed) << endl
+        << "# HELP hbv_cache_hits_total Parameter sets found in the cache." << endl
+        << "# TYPE hbv_cache_hits_total counter" << endl
+        << "hbv_cache_hits_total " << hbv_stats::cacheHits.load(memory_order_relaxed) << endl
+        << "# HELP hbv_cache_misses_total Parameter sets not found in the cache." << endl
+        << "# TYPE hbv_cache_misses_total counter" << endl
+        << "hbv_cache_misses_total " << hbv_stats::cacheMisses.load(memory_order_relaxed) << endl
+        << "# HELP hbv_queue_depth Tasks queued or running (batch mode) or blocks sent to the MPI workers." << endl
+        << "# TYPE hbv_queue_depth gauge" << endl
+        << "hbv_queue_depth " << hbv_stats::queueDepth.load(memory_order_relaxed) << endl
+        << "# HELP hbv_evaluation_seconds Wall-clock time of the model runs." << endl
+        << "# TYPE hbv_evaluation_seconds histogram" << endl;
+    long cumulative = 0;
+    for(int b=0; b<=hbv_stats::NBUCKETS; b++){
+        cumulative += hbv_stats::latency[b].load(memory_order_relaxed);
+        out << "hbv_evaluation_seconds_bucket{le=\"";
+        if(b < hbv_stats::NBUCKETS) out << hbv_stats::buckets[b];
+        else out << "+Inf";
+        out << "\"} " << cumulative << endl;
+    }
+    out << "hbv_evaluation_seconds_sum " << hbv_stats::latencySum.load(memory_order_relaxed)*1.0e-9 << endl
+        << "hbv_evaluation_seconds_count " << cumulative << endl
+        << "# HELP hbv_resident_memory_bytes Resident set size of the process." << endl
+        << "# TYPE hbv_resident_memory_bytes gauge" << endl
+        << "hbv_resident_memory_bytes " << rss << endl
+        << "# HELP hbv_uptime_seconds Time since the monitor started." << endl
+        << "# TYPE hbv_uptime_seconds gauge" << endl
+        << "hbv_uptime_seconds " << chrono::duration<double>(now - started).count() << endl;
+    return out.str();
+}
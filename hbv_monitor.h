@@ -0,0 +1,102 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_MONITOR_H
+#define HBV_MONITOR_H
+
+#include <atomic>
+#include <thread>
+#include <string>
+#include <chrono>
+
+namespace std{
+
+/**
+ * counters of the evaluations, updated by the threads with relaxed atomic
+ * operations (no locks) and read by the monitor; nothing is counted or
+ * timed unless a monitor is running
+ */
+struct hbv_stats
+{
+    static const int NBUCKETS = 12;
+    static const double buckets[NBUCKETS]; // upper bounds of the latency histogram (s)
+
+    static bool enabled;                    // set once, before the threads start
+    static atomic<long> evaluations;        // completed model runs
+    static atomic<long> aborted;            // runs stopped early (race)
+    static atomic<long> timeSteps;          // simulated time steps
+    static atomic<long> cacheHits;
+    static atomic<long> cacheMisses;
+    static atomic<long> queueDepth;         // tasks waiting or running (batch mode, MPI blocks in flight)
+    static atomic<long> latency[NBUCKETS+1]; // runs per latency bucket (last: above the largest bound)
+    static atomic<long> latencySum;         // total latency (ns)
+
+    static inline chrono::steady_clock::time_point start()
+    {
+        return enabled ? chrono::steady_clock::now() : chrono::steady_clock::time_point();
+    }
+
+    /**
+     * one completed run of nSteps time steps started at t0 (from start())
+     */
+    static void evaluation(chrono::steady_clock::time_point t0, int nSteps);
+
+    static inline void add(atomic<long> &counter, long n = 1)
+    {
+        if(enabled) counter.fetch_add(n, memory_order_relaxed);
+    }
+
+    static inline void set(atomic<long> &gauge, long n)
+    {
+        if(enabled) gauge.store(n, memory_order_relaxed);
+    }
+};
+
+/**
+ * Prometheus endpoint: a dedicated thread serves the counters in the text
+ * exposition format over HTTP, on a TCP port of the loopback interface or
+ * on a Unix socket (address "unix:PATH"), e.g.
+ *   curl http://localhost:9100/metrics
+ */
+class hbv_monitor
+{
+public:
+
+    hbv_monitor(string address);
+    virtual ~hbv_monitor();
+
+protected:
+
+    void serve();
+    void respond(int client);
+    string exposition();
+
+    string address;
+    int fd;
+    atomic<bool> stop;
+    thread server;
+
+    // start of the monitor (uptime); rates are computed by Prometheus from
+    // the counters, so scrapes do not change the state of the monitor
+    chrono::steady_clock::time_point started;
+
+};
+}
+
+#endif // HBV_MONITOR_H
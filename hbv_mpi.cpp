@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifdef HBV_MPI
+
+#include "hbv_mpi.h"
+#include "hbv_monitor.h"
+#include <algorithm>
+
+using namespace std;
+
+#define TAG_WORK 1
+#define TAG_RESULT 2
+#define TAG_STOP 3
+#define TAG_BANDS 4
+
+hbv_mpi_evaluator::hbv_mpi_evaluator(int nobjs, int blockSize)
+{
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    this->nobjs = nobjs;
+    this->blockSize = blockSize;
+    nWorkers = size-1;
+    requests.resize(nWorkers, MPI_REQUEST_NULL);
+    offset.resize(nWorkers, 0);
+    results.resize(nWorkers);
+}
+
+hbv_mpi_evaluator::~hbv_mpi_evaluator()
+{
+}
+
+int hbv_mpi_evaluator::getNumberOfObjectives()
+{
+    return nobjs;
+}
+
+void hbv_mpi_evaluator::sendBlock(int w, int nSol, const double *vars)
+{
+    int n = min(currentBlock, nSol - nextSol);
+    MPI_Send(&n, 1, MPI_INT, w+1, TAG_WORK, MPI_COMM_WORLD);
+    MPI_Send((void*)&vars[nextSol*hbv_model::nParams], n*hbv_model::nParams, MPI_DOUBLE, w+1, TAG_WORK, MPI_COMM_WORLD);
+
+    // the result is collected asynchronously
+    offset[w] = nextSol;
+    results[w].resize(n*nobjs);
+    MPI_Irecv(&results[w][0], n*nobjs, MPI_DOUBLE, w+1, TAG_RESULT, MPI_COMM_WORLD, &requests[w]);
+    nextSol += n;
+}
+
+void hbv_mpi_evaluator::evaluate(int nSol, const double *vars, double *objs)
+{
+    if(nSol <= 0) return;
+    currentBlock = blockSize > 0 ? blockSize : max(1, nSol/(4*nWorkers));
+    nextSol = 0;
+
+    int active = 0;
+    for(int w=0; w<nWorkers && nextSol<nSol; w++){
+        sendBlock(w, nSol, vars);
+        active++;
+    }
+
+    while(active > 0){
+        int w;
+        MPI_Waitany(nWorkers, &requests[0], &w, MPI_STATUS_IGNORE);
+        copy(results[w].begin(), results[w].end(), &objs[offset[w]*nobjs]);
+        active--;
+        hbv_stats::set(hbv_stats::queueDepth, active);
+
+        // the worker is idle: give it the next block
+        if(nextSol < nSol){
+            sendBlock(w, nSol, vars);
+            active++;
+            hbv_stats::set(hbv_stats::queueDepth, active);
+        }
+    }
+}
+
+void hbv_mpi_evaluator::terminate()
+{
+    int n = 0;
+    for(int w=0; w<nWorkers; w++){
+        MPI_Send(&n, 1, MPI_INT, w+1, TAG_STOP, MPI_COMM_WORLD);
+    }
+}
+
+
+void std::hbv_mpi_worker(hbv_pool &pool)
+{
+    int nobjs = pool.getNumberOfObjectives();
+    vector<double> vars, objs;
+    MPI_Status status;
+
+    while(true){
+        int n;
+        MPI_Recv(&n, 1, MPI_INT, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status);
+        if(status.MPI_TAG == TAG_STOP) break;
+
+        vars.resize(n*hbv_model::nParams);
+        objs.resize(n*nobjs);
+        MPI_Recv(&vars[0], n*hbv_model::nParams, MPI_DOUBLE, 0, TAG_WORK, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        pool.evaluate(n, &vars[0], &objs[0]);
+        MPI_Send(&objs[0], n*nobjs, MPI_DOUBLE, 0, TAG_RESULT, MPI_COMM_WORLD);
+    }
+}
+
+
+void std::hbv_mpi_reduce(hbv_bands &bands)
+{
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    vector<double> buf;
+    if(rank > 0){
+        bands.pack(buf);
+        long n = buf.size();
+        MPI_Send(&n, 1, MPI_LONG, 0, TAG_BANDS, MPI_COMM_WORLD);
+        MPI_Send(&buf[0], n, MPI_DOUBLE, 0, TAG_BANDS, MPI_COMM_WORLD);
+        return;
+    }
+    bands.merge();
+    for(int r=1; r<size; r++){
+        long n;
+        MPI_Recv(&n, 1, MPI_LONG, r, TAG_BANDS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        buf.resize(n);
+        MPI_Recv(&buf[0], n, MPI_DOUBLE, r, TAG_BANDS, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        bands.unpack(buf);
+    }
+}
+
+#endif // HBV_MPI
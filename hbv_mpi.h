@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_MPI_H
+#define HBV_MPI_H
+
+#ifdef HBV_MPI
+
+#include "hbv_pool.h"
+#include <mpi.h>
+#include <vector>
+
+namespace std{
+
+/**
+ * master side of the MPI master-worker evaluation (rank 0): the batch is
+ * split into blocks which are sent to the first idle worker (dynamic load
+ * balancing), results are gathered asynchronously and stored at the offset
+ * of their block, so the output is identical to the serial evaluation
+ */
+class hbv_mpi_evaluator : public hbv_evaluator
+{
+public:
+
+    hbv_mpi_evaluator(int nobjs, int blockSize);
+    virtual ~hbv_mpi_evaluator();
+
+    void evaluate(int nSol, const double *vars, double *objs);
+    int getNumberOfObjectives();
+
+    /**
+     * stop the workers (to be called once by the master)
+     */
+    void terminate();
+
+protected:
+
+    void sendBlock(int w, int nSol, const double *vars);
+
+    int nobjs;
+    int nWorkers;
+    int blockSize;      // 0 = automatic (4 blocks per worker)
+    int currentBlock;
+    int nextSol;
+    vector<MPI_Request> requests;
+    vector<int> offset;
+    vector<vector<double> > results;
+
+};
+
+/**
+ * worker side (rank > 0): receive blocks of parameter sets until the master
+ * stops, evaluate them with the local pool and send back the objectives
+ */
+void hbv_mpi_worker(hbv_pool &pool);
+
+/**
+ * merge the quantile bands of all the ranks into those of rank 0
+ */
+void hbv_mpi_reduce(hbv_bands &bands);
+
+}
+
+#endif // HBV_MPI
+
+#endif // HBV_MPI_H
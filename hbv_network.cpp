@@ -0,0 +1,217 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_network.h"
+#include "hbv_model.h"
+#include "hbv_scheduler.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+
+using namespace std;
+
+hbv_network::hbv_network(string filename)
+{
+    ifstream in(filename.c_str(), ios::in);
+    if(!in){
+        cout << "The network file specified: " << filename << " could not be found!" << endl;
+        exit(1);
+    }
+    string line;
+    while(getline(in, line)){
+        stringstream ss(line);
+        string name, routing;
+        if(!(ss >> name) || name[0] == '#') continue;
+
+        network_node *n = new network_node();
+        n->name = name;
+        if(!(ss >> n->forcingFile >> n->paramFile >> n->downstreamName >> routing)){
+            cout << "Invalid line of the network file " << filename << ": " << line << endl;
+            exit(1);
+        }
+
+        // routing: -, lag:K or muskingum:K:X
+        n->routing = network_node::NONE;
+        n->K = 0.0;
+        n->X = 0.0;
+        if(routing != "-"){
+            stringstream rs(routing);
+            string type, value;
+            getline(rs, type, ':');
+            if(getline(rs, value, ':')) n->K = atof(value.c_str());
+            if(getline(rs, value, ':')) n->X = atof(value.c_str());
+            if(type == "lag") n->routing = network_node::LAG;
+            else if(type == "muskingum") n->routing = network_node::MUSKINGUM;
+            else{
+                cout << "Unknown routing " << routing << " of sub-basin " << name << endl;
+                exit(1);
+            }
+        }
+
+        ifstream pin(n->paramFile.c_str(), ios::in);
+        for(int j=0; j<hbv_model::nParams; j++){
+            if(!(pin >> n->parameters[j])){
+                cout << "The parameter file " << n->paramFile << " must contain " << hbv_model::nParams << " values" << endl;
+                exit(1);
+            }
+        }
+        nodes.push_back(n);
+    }
+
+    // links and topological check (every sub-basin must reach an outlet)
+    for(unsigned int i=0; i<nodes.size(); i++){
+        nodes[i]->downstream = -1;
+        if(nodes[i]->downstreamName == "-") continue;
+        for(unsigned int k=0; k<nodes.size(); k++){
+            if(nodes[k]->name == nodes[i]->downstreamName) nodes[i]->downstream = k;
+        }
+        if(nodes[i]->downstream < 0){
+            cout << "Unknown downstream sub-basin " << nodes[i]->downstreamName << " of " << nodes[i]->name << endl;
+            exit(1);
+        }
+        nodes[nodes[i]->downstream]->upstream.push_back(i);
+    }
+    for(unsigned int i=0; i<nodes.size(); i++){
+        int steps = 0;
+        for(int k=i; k>=0; k=nodes[k]->downstream){
+            if(steps++ > (int)nodes.size()){
+                cout << "The network contains a loop through sub-basin " << nodes[i]->name << endl;
+                exit(1);
+            }
+        }
+    }
+}
+
+hbv_network::~hbv_network()
+{
+    for(unsigned int i=0; i<nodes.size(); i++) delete nodes[i];
+}
+
+
+void hbv_network::run(int nThreads, bool affinity)
+{
+    // the headwater sub-basins start, the others wait for their upstream ones
+    vector<int> headwaters;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        nodes[i]->pending = nodes[i]->upstream.size();
+        if(nodes[i]->upstream.empty()) headwaters.push_back(i);
+    }
+
+    hbv_scheduler scheduler(nThreads, affinity);
+    scheduler.run(headwaters, [this, &scheduler](int thread, int i){
+        simulate(i);
+        int d = nodes[i]->downstream;
+        if(d >= 0 && --nodes[d]->pending == 0) scheduler.spawn(thread, d);
+    });
+}
+
+
+void hbv_network::simulate(int i)
+{
+    network_node *node = nodes[i];
+    hbv_model model(node->forcingFile);
+    model.setStoreStates(false);
+    model.calc_HBV(node->parameters);
+
+    int n = model.getData().nDays;
+    double area = model.getData().DA;
+    const double *Qsim = model.getFluxes().Qsim;
+    node->nDays = n;
+    node->timeStep = model.getTimeStep();
+    for(unsigned int k=0; k<node->upstream.size(); k++){
+        network_node *up = nodes[node->upstream[k]];
+        if(up->nDays != n || up->timeStep != node->timeStep){
+            cout << "The forcing of sub-basins " << node->name << " and " << up->name << " do not have the same time steps" << endl;
+            exit(1);
+        }
+    }
+
+    // local runoff and routed inflows, as volumes (mm x area)
+    vector<double> volume(Qsim, Qsim+n);
+    for(int t=0; t<n; t++) volume[t] *= area;
+    node->area = area;
+    for(unsigned int k=0; k<node->upstream.size(); k++){
+        network_node *up = nodes[node->upstream[k]];
+        for(int t=0; t<n; t++) volume[t] += up->edge[t];
+        node->area += up->area;
+        vector<double>().swap(up->edge);
+    }
+    model.hbv_delete(n);
+
+    if(node->downstream >= 0){
+        route(node, volume, node->edge);
+    }else{
+        node->outflow.resize(n);
+        for(int t=0; t<n; t++) node->outflow[t] = volume[t]/node->area;
+    }
+}
+
+
+void hbv_network::route(network_node *node, const vector<double> &in, vector<double> &out)
+{
+    int n = in.size();
+    out.assign(n, 0.0);
+    if(node->routing == network_node::LAG){
+        int lag = ROUNDINT(node->K);
+        for(int t=lag; t<n; t++) out[t] = in[t-lag];
+    }else if(node->routing == network_node::MUSKINGUM){
+        // O(t) = C0 I(t) + C1 I(t-1) + C2 O(t-1), with a time step of 1
+        double K = node->K, X = node->X;
+        double D = 2.0*K*(1.0-X) + 1.0;
+        double C0 = (1.0 - 2.0*K*X)/D;
+        double C1 = (1.0 + 2.0*K*X)/D;
+        double C2 = (2.0*K*(1.0-X) - 1.0)/D;
+        if(n > 0) out[0] = in[0];
+        for(int t=1; t<n; t++) out[t] = C0*in[t] + C1*in[t-1] + C2*out[t-1];
+    }else{
+        out = in;
+    }
+}
+
+
+void hbv_network::write(string filename)
+{
+    int nDays = -1;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        if(nodes[i]->downstream >= 0) continue;
+        if(nDays >= 0 && nodes[i]->nDays != nDays){
+            cout << "The outlets of the network do not have the same time steps" << endl;
+            exit(1);
+        }
+        nDays = nodes[i]->nDays;
+    }
+
+    ofstream out(filename.c_str(), ios::out);
+    out << "#";
+    for(unsigned int i=0; i<nodes.size(); i++){
+        if(nodes[i]->downstream < 0) out << " " << nodes[i]->name;
+    }
+    out << endl;
+    for(int t=0; t<nDays; t++){
+        bool first = true;
+        for(unsigned int i=0; i<nodes.size(); i++){
+            if(nodes[i]->downstream >= 0) continue;
+            out << (first ? "" : " ") << nodes[i]->outflow[t];
+            first = false;
+        }
+        out << endl;
+    }
+    out.close();
+}
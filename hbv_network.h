@@ -0,0 +1,91 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_NETWORK_H
+#define HBV_NETWORK_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+namespace std{
+
+/**
+ * sub-basin of a river network and the reach to its downstream sub-basin
+ */
+struct network_node
+{
+    string name;
+    string forcingFile;
+    string paramFile;
+    string downstreamName;
+    int downstream;         // index of the downstream node (-1 = outlet)
+    vector<int> upstream;
+
+    // channel routing of the outflow to the downstream node
+    enum { NONE, LAG, MUSKINGUM } routing;
+    double K;               // lag or Muskingum storage constant (time steps)
+    double X;               // Muskingum weighting factor
+
+    double parameters[12];
+    double area;            // contributing area (sub-basin and upstream ones)
+    int nDays;              // time steps of the forcing
+    double timeStep;
+    atomic<int> pending;    // upstream nodes not yet simulated
+    vector<double> edge;    // routed outflow (volume per time step) to the downstream node
+    vector<double> outflow; // outflow of an outlet (mm per time step over its contributing area)
+};
+
+/**
+ * Network of HBV sub-basins (a tree draining to one or more outlets), read
+ * from a file with one line per sub-basin:
+ *   name forcing_file parameter_file downstream routing
+ * where downstream is the name of the downstream sub-basin (- for an outlet)
+ * and routing is lag:K, muskingum:K:X (K in time steps) or - (none). The
+ * drainage area of each forcing file is the area of the sub-basin only.
+ * Each sub-basin is a task of a work-stealing pool, spawned when all its
+ * upstream sub-basins are completed, so independent branches run
+ * concurrently; the tasks exchange only the routed series of the reaches
+ * (as volumes), which are released once used.
+ */
+class hbv_network
+{
+public:
+
+    hbv_network(string filename);
+    virtual ~hbv_network();
+
+    void run(int nThreads, bool affinity);
+
+    /**
+     * save the flows of the outlets (one column per outlet)
+     */
+    void write(string filename);
+
+protected:
+
+    void simulate(int i);
+    static void route(network_node *node, const vector<double> &in, vector<double> &out);
+
+    vector<network_node*> nodes;
+
+};
+}
+
+#endif // HBV_NETWORK_H
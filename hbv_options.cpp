@@ -0,0 +1,292 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_options.h"
+#include "hbv_metrics.h"
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+
+using namespace std;
+
+void std::printUsage(const char *exe){
+
+    cout << "Usage: " << exe << " input_file [output_file] [options]" << endl;
+    cout << "  --mode sim|moea|dream|bulk|glue|batch|network|regional|enkf|extremes|scenarios  simulation/MOEA Framework" << endl;
+    cout << "                           protocol (default), native calibration, posterior sampling, bulk sampling, GLUE, batch" << endl;
+    cout << "                           of catchments, river network, regional parameter sets (the input file is then a" << endl;
+    cout << "                           manifest or the list of sub-basins or catchments, see README), data assimilation, flood" << endl;
+    cout << "                           frequency analysis or climate stress test" << endl;
+    cout << "  --objectives m1[,m2,...] metrics to be computed (default alpha,beta,r)" << endl;
+    cout << "                           available: " << hbv_metrics::available() << endl;
+    cout << "  --signatures FILE        save the hydrologic signatures of each parameter set (simulation mode)" << endl;
+    cout << "  --cache FILE             reuse the results stored in FILE and add the new ones" << endl;
+    cout << "  --cache-resolution R     parameters closer than R (fraction of their range) share the results (default 1e-9)" << endl;
+    cout << "  --cache-traces 0|1       store the compressed simulated flows in the cache (default 0)" << endl;
+    cout << "  --monthly FILE           save the monthly volumes and mean and maximum flows of each run (simulation mode)" << endl;
+    cout << "  --annual FILE            save the annual water balance and maximum flow of each run (simulation mode)" << endl;
+    cout << "  --states FILE            save the states and fluxes of the last parameter set (simulation mode)" << endl;
+    cout << "  --window FIRST:LAST      time steps [FIRST, LAST) saved with --states (default: whole record)" << endl;
+    cout << "  --trace-interval K       time steps between the snapshots re-simulated for --states (default 365)" << endl;
+    cout << "  --race STAGES            evaluate the batches (moea, bulk) as a race over sub-periods: comma-separated" << endl;
+    cout << "                           DAYS:METRIC:max:VALUE or DAYS:METRIC:best:FRACTION, e.g. 3650:nse:best:0.5" << endl;
+    cout << "  --bands FILE             save quantiles (--quantiles) of the flows of all the runs at each time step" << endl;
+    cout << "                           (sim, bulk and enkf modes: parameter sets, rows of the design or members)" << endl;
+    cout << "  --monitor PORT|unix:PATH serve Prometheus metrics (evaluations, latency, cache, queue, memory) on" << endl;
+    cout << "                           http://localhost:PORT/metrics or a Unix socket (MPI: PORT+rank, PATH.rank)" << endl;
+    cout << "  --threads N              number of threads (default: number of cores, 1 per MPI rank)" << endl;
+    cout << "  --store-states 0|1       keep the states of every time step (default 1) or only the current ones" << endl;
+    cout << "  --fast-pow 0|1           vectorizable approximation of the soil moisture power (relative error below" << endl;
+    cout << "                           2e-13, default 0: pow of the C library)" << endl;
+    cout << "  --block N                parameter sets per MPI message or batch task (default: automatic)" << endl;
+    cout << "  --affinity 0|1           pin the threads of the batch and network modes to the cores (default 1)" << endl;
+    cout << "  --aggregate mean|worst|all  objectives of the regional mode: weighted mean or worst value over the" << endl;
+    cout << "                           catchments, or the objectives of every catchment (default mean)" << endl;
+    cout << "bulk sampling (--mode bulk):" << endl;
+    cout << "  --design lhs|sobol|FILE  Latin hypercube, Sobol sequence or binary matrix of N x 12 doubles (default lhs)" << endl;
+    cout << "  --samples N              rows of the generated designs (default 1000)" << endl;
+    cout << "  --start N, --stop N      range of rows evaluated by this process (default: all)" << endl;
+    cout << "  --results FILE           binary matrix of N x M doubles with the objectives of each row" << endl;
+    cout << "GLUE (--mode glue, also --design, --samples, --start, --stop):" << endl;
+    cout << "  --behavioural METRIC:VALUE  runs with METRIC below VALUE are behavioural, with weight VALUE - METRIC" << endl;
+    cout << "                           (default nse:-0.5, i.e. NSE above 0.5 with weight NSE - 0.5)" << endl;
+    cout << "  --quantiles q1[,q2,...]  quantiles of the prediction bounds and --bands (default 0.05,0.25,0.5,0.75,0.95)" << endl;
+    cout << "  --digest-size C          compression of the quantile sketch of each time step, larger is more" << endl;
+    cout << "                           accurate (default 100)" << endl;
+    cout << "data assimilation (--mode enkf, parameters on stdin):" << endl;
+    cout << "  --members N              ensemble size (default 100)" << endl;
+    cout << "  --obs-error E            relative error of the observed flows (default 0.1)" << endl;
+    cout << "  --precip-error E         standard deviation of the log of the precipitation multiplier (default 0.3)" << endl;
+    cout << "flood frequency analysis (--mode extremes, parameter sets on stdin, also --seed):" << endl;
+    cout << "  --synthetic YEARS        simulate YEARS of forcing from a weather generator fitted on the input file" << endl;
+    cout << "                           (default 0: the input file itself)" << endl;
+    cout << "  --chunk N                time steps of forcing read at once (default 4096)" << endl;
+    cout << "  --pot-rate L             peaks over the threshold per year on average (default 2)" << endl;
+    cout << "  --separation DAYS        minimum time between two independent peaks (default 7)" << endl;
+    cout << "  --return-periods T1[,T2,...]  return periods of the flood quantiles (default 2,10,100,1000)" << endl;
+    cout << "  --events FILE            save the annual maxima and the peaks of each parameter set with their dates" << endl;
+    cout << "climate stress test (--mode scenarios, parameter sets on stdin):" << endl;
+    cout << "  --scenarios FILE         one scenario per line: precipitation factor and temperature change (Celsius)," << endl;
+    cout << "                           or 12 monthly factors and 12 monthly changes" << endl;
+    cout << "native calibration (--mode moea):" << endl;
+    cout << "  --nfe N                  number of function evaluations (default 10000)" << endl;
+    cout << "  --pop N                  population size (default 100)" << endl;
+    cout << "  --seed N                 random seed (default 1)" << endl;
+    cout << "  --eps e1[,e2,...]        epsilon of the objectives (default 0.01)" << endl;
+    cout << "  --checkpoint FILE        save the population to FILE" << endl;
+    cout << "  --checkpoint-freq N      generations between checkpoints (default 10)" << endl;
+    cout << "  --resume FILE            restart from a checkpoint" << endl;
+    cout << "  --surrogate N            discard the offspring that an RBF surrogate trained on the last N" << endl;
+    cout << "                           evaluations predicts to be dominated by the archive (default 0 = off)" << endl;
+    cout << "  --surrogate-exact F      fraction of the offspring always simulated (default 0.2)" << endl;
+    cout << "posterior sampling (--mode dream, also --nfe and --seed):" << endl;
+    cout << "  --likelihood gaussian|hetero|log  error model: iid Gaussian errors of the flows (default)," << endl;
+    cout << "                           standard deviation growing with the flow, or iid errors of the log-flows" << endl;
+    cout << "  --chains N               number of Markov chains (default 8)" << endl;
+    cout << "  --burn-in F              fraction of the generations discarded (default 0.5)" << endl;
+    cout << "  --thin N                 generations between two saved samples (default 1)" << endl;
+    cout << "  --posterior FILE         binary matrix of the samples: rows of 12 parameters and the log-likelihood" << endl;
+    cout << "  --report N               generations between two R-hat reports on stderr (default 100)" << endl;
+}
+
+vector<double> std::parseList(string s){
+
+    vector<double> v;
+    stringstream ss(s);
+    string item;
+    while(getline(ss, item, ',')){
+        v.push_back(atof(item.c_str()));
+    }
+    return v;
+}
+
+vector<string> std::parseNames(string s){
+
+    vector<string> v;
+    stringstream ss(s);
+    string item;
+    while(getline(ss, item, ',')){
+        if(!item.empty()) v.push_back(item);
+    }
+    return v;
+}
+
+void std::parseOptions(int argc, char **argv, hbv_options &opt){
+
+    // default settings
+    opt.mode = "sim";
+    opt.objectives = "alpha,beta,r";
+    opt.nThreads = 0;
+    opt.blockSize = 0;
+    opt.affinity = true;
+    opt.aggregate = "mean";
+    opt.storeStates = true;
+    opt.fastPow = false;
+    opt.cacheResolution = 1.0e-9;
+    opt.cacheTraces = false;
+    opt.design = "lhs";
+    opt.nSamples = 1000;
+    opt.shardStart = 0;
+    opt.shardStop = -1;
+    opt.windowFirst = 0;
+    opt.windowLast = -1;
+    opt.traceInterval = 365;
+    opt.members = 100;
+    opt.obsError = 0.1;
+    opt.precipError = 0.3;
+    opt.behavioural = "nse:-0.5";
+    opt.quantiles = parseList("0.05,0.25,0.5,0.75,0.95");
+    opt.digestSize = 100.0;
+    opt.likelihood = "gaussian";
+    opt.dream.nChains = 8;
+    opt.dream.burnIn = 0.5;
+    opt.dream.thin = 1;
+    opt.dream.nCR = 3;
+    opt.dream.nDelta = 3;
+    opt.dream.reportFreq = 100;
+    opt.extremes.years = 0;
+    opt.extremes.chunk = 4096;
+    opt.extremes.potRate = 2.0;
+    opt.extremes.separation = 7.0;
+    opt.extremes.returnPeriods = parseList("2,10,100,1000");
+    opt.moea.popSize = 100;
+    opt.moea.maxNFE = 10000;
+    opt.moea.seed = 1;
+    opt.moea.eps = vector<double>(1, 0.01);
+    opt.moea.pc = 1.0;
+    opt.moea.etaC = 15.0;
+    opt.moea.etaM = 20.0;
+    opt.moea.checkpointFreq = 10;
+    opt.moea.surrogateSize = 0;
+    opt.moea.exactFraction = 0.2;
+
+    vector<string> positional;
+    for(int i=1; i<argc; i++){
+        string key = argv[i];
+        if(key.compare(0, 2, "--") != 0){
+            positional.push_back(key);
+            continue;
+        }
+        if(i+1 >= argc){
+            cout << "Missing value for option " << key << endl;
+            printUsage(argv[0]);
+            exit(1);
+        }
+        string value = argv[++i];
+
+        if(key == "--mode") opt.mode = value;
+        else if(key == "--objectives") opt.objectives = value;
+        else if(key == "--signatures") opt.signatureFile = value;
+        else if(key == "--cache") opt.cacheFile = value;
+        else if(key == "--cache-resolution") opt.cacheResolution = atof(value.c_str());
+        else if(key == "--cache-traces") opt.cacheTraces = atoi(value.c_str()) != 0;
+        else if(key == "--race") opt.race = value;
+        else if(key == "--monthly") opt.monthlyFile = value;
+        else if(key == "--annual") opt.annualFile = value;
+        else if(key == "--states") opt.statesFile = value;
+        else if(key == "--window"){
+            size_t colon = value.find(':');
+            opt.windowFirst = atoi(value.substr(0, colon).c_str());
+            opt.windowLast = colon == string::npos ? -1 : atoi(value.substr(colon+1).c_str());
+        }
+        else if(key == "--trace-interval") opt.traceInterval = atoi(value.c_str());
+        else if(key == "--monitor") opt.monitor = value;
+        else if(key == "--threads") opt.nThreads = atoi(value.c_str());
+        else if(key == "--fast-pow") opt.fastPow = atoi(value.c_str()) != 0;
+        else if(key == "--store-states") opt.storeStates = atoi(value.c_str()) != 0;
+        else if(key == "--block") opt.blockSize = atoi(value.c_str());
+        else if(key == "--affinity") opt.affinity = atoi(value.c_str()) != 0;
+        else if(key == "--aggregate") opt.aggregate = value;
+        else if(key == "--design") opt.design = value;
+        else if(key == "--samples") opt.nSamples = atol(value.c_str());
+        else if(key == "--start") opt.shardStart = atol(value.c_str());
+        else if(key == "--stop") opt.shardStop = atol(value.c_str());
+        else if(key == "--results") opt.resultsFile = value;
+        else if(key == "--behavioural") opt.behavioural = value;
+        else if(key == "--bands") opt.bandsFile = value;
+        else if(key == "--quantiles") opt.quantiles = parseList(value);
+        else if(key == "--digest-size") opt.digestSize = atof(value.c_str());
+        else if(key == "--members") opt.members = atoi(value.c_str());
+        else if(key == "--obs-error") opt.obsError = atof(value.c_str());
+        else if(key == "--precip-error") opt.precipError = atof(value.c_str());
+        else if(key == "--likelihood") opt.likelihood = value;
+        else if(key == "--chains") opt.dream.nChains = atoi(value.c_str());
+        else if(key == "--burn-in") opt.dream.burnIn = atof(value.c_str());
+        else if(key == "--thin") opt.dream.thin = atoi(value.c_str());
+        else if(key == "--posterior") opt.dream.posteriorFile = value;
+        else if(key == "--report") opt.dream.reportFreq = atoi(value.c_str());
+        else if(key == "--scenarios") opt.scenarioFile = value;
+        else if(key == "--synthetic") opt.extremes.years = atol(value.c_str());
+        else if(key == "--chunk") opt.extremes.chunk = atoi(value.c_str());
+        else if(key == "--pot-rate") opt.extremes.potRate = atof(value.c_str());
+        else if(key == "--separation") opt.extremes.separation = atof(value.c_str());
+        else if(key == "--return-periods") opt.extremes.returnPeriods = parseList(value);
+        else if(key == "--events") opt.extremes.eventsFile = value;
+        else if(key == "--nfe") opt.moea.maxNFE = atoi(value.c_str());
+        else if(key == "--pop") opt.moea.popSize = atoi(value.c_str());
+        else if(key == "--seed") opt.moea.seed = atoi(value.c_str());
+        else if(key == "--eps") opt.moea.eps = parseList(value);
+        else if(key == "--checkpoint") opt.moea.checkpointFile = value;
+        else if(key == "--checkpoint-freq") opt.moea.checkpointFreq = atoi(value.c_str());
+        else if(key == "--resume") opt.moea.resumeFile = value;
+        else if(key == "--surrogate") opt.moea.surrogateSize = atoi(value.c_str());
+        else if(key == "--surrogate-exact") opt.moea.exactFraction = atof(value.c_str());
+        else{
+            cout << "Unknown option " << key << endl;
+            printUsage(argv[0]);
+            exit(1);
+        }
+    }
+
+    if(positional.empty()){
+        printUsage(argv[0]);
+        exit(1);
+    }
+    static const char *modes[] = {"sim", "moea", "dream", "bulk", "glue", "batch", "network",
+                                  "regional", "enkf", "extremes", "scenarios"};
+    bool knownMode = false;
+    for(size_t m=0; m<sizeof(modes)/sizeof(modes[0]); m++){
+        if(opt.mode == modes[m]) knownMode = true;
+    }
+    if(!knownMode){
+        cout << "Unknown mode " << opt.mode << endl;
+        printUsage(argv[0]);
+        exit(1);
+    }
+    opt.inputFile = positional[0];
+    if(positional.size() > 1){
+        opt.outputFile = positional[1];
+    }
+
+    // posterior sampling: the only objective is the negative log-likelihood
+    // (set here so that the MPI workers evaluate the same metric)
+    if(opt.mode == "dream"){
+        if(opt.likelihood == "gaussian") opt.objectives = "loglik";
+        else if(opt.likelihood == "hetero") opt.objectives = "loglik_hetero";
+        else if(opt.likelihood == "log") opt.objectives = "loglik_log";
+        else{
+            cout << "Unknown likelihood " << opt.likelihood << endl;
+            exit(1);
+        }
+    }
+    opt.dream.maxNFE = opt.moea.maxNFE;
+    opt.dream.seed = opt.moea.seed;
+    opt.extremes.seed = opt.moea.seed;
+    if(opt.extremes.chunk < 1) opt.extremes.chunk = 1;
+    if(opt.dream.thin < 1) opt.dream.thin = 1;
+}
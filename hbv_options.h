@@ -0,0 +1,91 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_OPTIONS_H
+#define HBV_OPTIONS_H
+
+#include "hbv_moea.h"
+#include "hbv_dream.h"
+#include "hbv_extremes.h"
+#include <string>
+#include <vector>
+
+namespace std{
+
+/**
+ * command line of SimHBV:
+ *   SimHBV input_file [output_file] [--option value ...]
+ */
+struct hbv_options
+{
+    string inputFile;   // forcing data
+    string outputFile;  // simulated flows (simulation mode only)
+    string mode;        // "sim" (MOEA Framework protocol on stdin/out), "moea" (native calibration), "dream", "bulk", "glue", "batch", "network", "regional", "enkf", "extremes" or "scenarios"
+    int nThreads;       // number of threads for the batch evaluations (0 = automatic)
+    string monitor;     // address of the Prometheus endpoint: PORT or unix:PATH (empty = none)
+    bool storeStates;   // store the states of every time step (simulation mode)
+    bool fastPow;       // approximate power function in the soil routine
+    string cacheFile;   // persistent result cache (empty = none)
+    double cacheResolution; // quantization of the parameters in the cache (fraction of the range)
+    bool cacheTraces;   // store the simulated flows in the cache
+    int blockSize;      // parameter sets per MPI message or batch task (0 = automatic)
+    bool affinity;      // pin the threads of the batch mode to the cores
+    string aggregate;   // regional mode: "mean", "worst" or "all" (objectives of every catchment)
+    string objectives;  // comma-separated list of metrics (see hbv_metrics)
+    string signatureFile; // hydrologic signatures of each run (simulation mode)
+    string design;      // bulk mode: "lhs", "sobol" or binary parameter matrix
+    long nSamples;      // bulk mode: rows of the generated designs
+    long shardStart;    // bulk mode: first row evaluated by this process
+    long shardStop;     // bulk mode: row after the last one (-1 = end of the design)
+    string resultsFile; // bulk mode: binary matrix of the objectives
+    string behavioural; // glue mode: behavioural criterion METRIC:VALUE
+    string bandsFile;   // quantiles of the flows of all the runs at each time step (sim, bulk, enkf)
+    vector<double> quantiles; // quantiles of the bands and of the glue prediction bounds
+    double digestSize;  // compression of the quantile sketches (centroids per time step)
+    string race;        // stages of the racing evaluation (empty = full runs)
+    string statesFile;  // states and fluxes of the last run (simulation mode)
+    string scenarioFile; // scenarios mode: delta changes of the forcing, one scenario per line
+    string monthlyFile; // monthly aggregates of each run (simulation mode)
+    string annualFile;  // annual water balance and maxima of each run (simulation mode)
+    int windowFirst;    // first time step saved in statesFile
+    int windowLast;     // time step after the last one saved (-1 = end of the record)
+    int traceInterval;  // time steps between the snapshots of the trace replay
+    int members;        // enkf mode: ensemble size
+    double obsError;    // enkf mode: relative error of the flow observations
+    double precipError; // enkf mode: error of the precipitation (standard deviation of the log multiplier)
+    moea_settings moea; // settings of the native calibration
+    string likelihood;  // dream mode: "gaussian", "hetero" or "log"
+    dream_settings dream; // settings of the posterior sampling (nfe and seed of the calibration)
+    extremes_settings extremes; // flood frequency analysis of long series (seed of the calibration)
+};
+
+/**
+ * parse the command line (exit with a usage message on errors)
+ */
+void parseOptions(int argc, char **argv, hbv_options &opt);
+void printUsage(const char *exe);
+
+/**
+ * split a comma-separated list of numbers
+ */
+vector<double> parseList(string s);
+vector<string> parseNames(string s);
+
+}
+
+#endif // HBV_OPTIONS_H
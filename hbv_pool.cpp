@@ -0,0 +1,170 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_pool.h"
+#include "hbv_monitor.h"
+#include <algorithm>
+
+using namespace std;
+
+hbv_pool::hbv_pool(hbv_model *base, hbv_metrics *metrics, int nThreads)
+{
+    this->base = base;
+    this->metrics = metrics;
+    this->nThreads = nThreads > 0 ? nThreads : defaultThreads();
+    nobjs = metrics->size();
+    cache = NULL;
+    bands = NULL;
+
+    // thread 0 uses the base model, the others a copy sharing its data
+    models.push_back(base);
+    for(int i=1; i<this->nThreads; i++){
+        models.push_back(new hbv_model(base));
+        // only the flows are needed by the objectives
+        models.back()->setStoreStates(false);
+    }
+
+    generation = 0;
+    stopping = false;
+    current = NULL;
+    nTasks = 0;
+    active = 0;
+    for(int t=1; t<this->nThreads; t++){
+        threads.push_back(thread(&hbv_pool::waiting, this, t));
+    }
+}
+
+hbv_pool::~hbv_pool()
+{
+    {
+        lock_guard<mutex> lock(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(unsigned int t=0; t<threads.size(); t++){
+        threads[t].join();
+    }
+    for(unsigned int i=1; i<models.size(); i++){
+        models[i]->hbv_delete(models[i]->getData().nDays);
+        delete models[i];
+    }
+}
+
+int hbv_pool::defaultThreads()
+{
+    int n = thread::hardware_concurrency();
+    return n > 0 ? n : 1;
+}
+
+int hbv_pool::getNumberOfThreads()
+{
+    return nThreads;
+}
+
+void hbv_pool::setCache(hbv_cache *cache)
+{
+    this->cache = cache;
+}
+
+void hbv_pool::setBands(hbv_bands *bands)
+{
+    this->bands = bands;
+}
+
+int hbv_pool::threadIndex(hbv_model *model)
+{
+    return find(models.begin(), models.end(), model) - models.begin();
+}
+
+int hbv_pool::getNumberOfObjectives()
+{
+    return nobjs;
+}
+
+void hbv_pool::worker(int id, int n, const function<void(hbv_model*, int)> &task)
+{
+    // tasks are taken one at a time (dynamic load balancing)
+    for(int i = next++; i < n; i = next++){
+        task(models[id], i);
+    }
+}
+
+void hbv_pool::waiting(int id)
+{
+    long seen = 0;
+    unique_lock<mutex> lock(stateLock);
+    for(;;){
+        wake.wait(lock, [this, seen]{ return stopping || generation != seen; });
+        if(stopping) return;
+        seen = generation;
+        int n = nTasks;
+        const function<void(hbv_model*, int)> *task = current;
+        lock.unlock();
+
+        worker(id, n, *task);
+
+        lock.lock();
+        if(--active == 0) done.notify_all();
+    }
+}
+
+void hbv_pool::parallel(int n, const function<void(hbv_model*, int)> &task)
+{
+    next = 0;
+    if(min(nThreads, n) <= 1){
+        worker(0, n, task);
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(stateLock);
+        current = &task;
+        nTasks = n;
+        active = nThreads - 1;
+        generation++;
+    }
+    wake.notify_all();
+    worker(0, n, task);
+
+    // the task must outlive every thread still inside worker()
+    unique_lock<mutex> lock(stateLock);
+    done.wait(lock, [this]{ return active == 0; });
+}
+
+void hbv_pool::evaluate(int nSol, const double *vars, double *objs)
+{
+    parallel(nSol, [this, vars, objs](hbv_model *model, int i){
+        int nDays = model->getData().nDays;
+        const double *x = &vars[i*hbv_model::nParams];
+        hbv_cache_key key;
+        if(cache != NULL){
+            key = cache->makeKey(x);
+            if(bands == NULL && cache->lookup(key, &objs[i*nobjs])) return;
+        }
+
+        chrono::steady_clock::time_point t0 = hbv_stats::start();
+        model->calc_HBV((double*)x);
+        metrics->evaluate(hbv_span(model->getFluxes().Qsim, nDays), &objs[i*nobjs]);
+        hbv_stats::evaluation(t0, nDays);
+        if(bands != NULL) bands->add(threadIndex(model), model->getFluxes().Qsim);
+
+        if(cache != NULL){
+            cache->insert(key, &objs[i*nobjs], model->getFluxes().Qsim, nDays);
+        }
+    });
+}
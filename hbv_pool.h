@@ -0,0 +1,124 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_POOL_H
+#define HBV_POOL_H
+
+#include "hbv_model.h"
+#include "hbv_metrics.h"
+#include "hbv_cache.h"
+#include "hbv_bands.h"
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <ostream>
+
+namespace std{
+
+/**
+ * generic evaluator of a batch of parameter sets: vars is nSol x nvars and
+ * objs is nSol x nobjs, both stored row by row
+ */
+class hbv_evaluator
+{
+public:
+    virtual ~hbv_evaluator() {}
+    virtual void evaluate(int nSol, const double *vars, double *objs) = 0;
+    virtual int getNumberOfObjectives() = 0;
+};
+
+/**
+ * evaluation of a batch of parameter sets in parallel: each thread owns an
+ * HBV instance sharing the input data of the base model
+ */
+class hbv_pool : public hbv_evaluator
+{
+public:
+
+    hbv_pool(hbv_model *base, hbv_metrics *metrics, int nThreads);
+    virtual ~hbv_pool();
+
+    void evaluate(int nSol, const double *vars, double *objs);
+    int getNumberOfObjectives();
+
+    /**
+     * statistics of the evaluations (if any)
+     */
+    virtual void printStatistics(ostream &) {}
+
+    int getNumberOfThreads();
+
+    /**
+     * results already in the cache are not simulated again (cache can be NULL)
+     */
+    void setCache(hbv_cache *cache);
+
+    /**
+     * the simulated flows of every evaluation are added to the quantile bands
+     * (bands can be NULL, the cache is then only used to store the results)
+     */
+    void setBands(hbv_bands *bands);
+
+    /**
+     * number of threads used when nThreads <= 0 (number of cores)
+     */
+    static int defaultThreads();
+
+protected:
+
+    /**
+     * run task(model, i) for i = 0..n-1 on the threads, each with its own model
+     * (the calling thread is thread 0, the others are created once by the
+     * constructor and sleep on a condition variable between two calls)
+     */
+    void parallel(int n, const function<void(hbv_model*, int)> &task);
+    void worker(int id, int n, const function<void(hbv_model*, int)> &task);
+
+    // index of the thread owning a model
+    int threadIndex(hbv_model *model);
+
+    int nThreads;
+    int nobjs;
+    hbv_model *base;
+    hbv_metrics *metrics; // shared by the threads (read-only)
+    hbv_cache *cache;
+    hbv_bands *bands;
+    vector<hbv_model*> models;
+    atomic<int> next; // next task to be run (shared by the threads)
+
+private:
+
+    // loop of the persistent thread id (1..nThreads-1)
+    void waiting(int id);
+
+    vector<thread> threads;
+    mutex stateLock;
+    condition_variable wake, done;
+    long generation; // incremented by every parallel() call
+    bool stopping;
+    const function<void(hbv_model*, int)> *current;
+    int nTasks;
+    int active; // persistent threads still running the current call
+
+};
+}
+
+#endif // HBV_POOL_H
@@ -0,0 +1,176 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_race.h"
+#include "hbv_options.h"
+#include "hbv_monitor.h"
+#include <algorithm>
+#include <iostream>
+#include <cstdlib>
+#include <limits>
+#include <math.h>
+
+using namespace std;
+
+hbv_race::hbv_race(hbv_model *base, hbv_metrics *metrics, string spec, int nThreads) : hbv_pool(base, metrics, nThreads)
+{
+    nDays = base->getData().nDays;
+    int warmup = base->getWarmup();
+    hbv_span Qobs(base->getData().flow, nDays);
+    hbv_span precip(base->getData().precip, nDays);
+
+    vector<string> items = parseNames(spec);
+    for(unsigned int k=0; k<items.size(); k++){
+        // DAYS:METRIC:max|best:VALUE
+        vector<string> f;
+        size_t pos = 0, colon;
+        while((colon = items[k].find(':', pos)) != string::npos){
+            f.push_back(items[k].substr(pos, colon-pos));
+            pos = colon + 1;
+        }
+        f.push_back(items[k].substr(pos));
+
+        race_stage s;
+        if(f.size() == 4){
+            s.step = ROUNDINT(atof(f[0].c_str())*86400.0/base->getTimeStep());
+            s.best = f[2] == "best";
+            s.value = atof(f[3].c_str());
+        }
+        int previous = stages.empty() ? warmup : stages.back().step;
+        if(f.size() != 4 || (f[2] != "max" && f[2] != "best") || s.step <= previous || s.step >= nDays ||
+                (s.best && (s.value <= 0.0 || s.value > 1.0))){
+            cout << "Invalid race stage " << items[k] << " (DAYS:METRIC:max:VALUE or DAYS:METRIC:best:FRACTION, "
+                 << "with DAYS increasing, after the warm-up and within the record)" << endl;
+            exit(1);
+        }
+        // the metric is computed on the sub-period only
+        s.metric = new hbv_metrics(f[1], hbv_span(Qobs.data, s.step), hbv_span(precip.data, s.step), warmup);
+        if(s.metric->size() != 1){
+            cout << "Invalid race stage " << items[k] << ": one metric per stage" << endl;
+            exit(1);
+        }
+        stages.push_back(s);
+    }
+
+    candidates = 0;
+    eliminated.assign(stages.size(), 0);
+    simulated = 0;
+    saved = 0;
+}
+
+hbv_race::~hbv_race()
+{
+    for(unsigned int k=0; k<stages.size(); k++) delete stages[k].metric;
+}
+
+
+void hbv_race::evaluate(int nSol, const double *vars, double *objs)
+{
+    int nvars = hbv_model::nParams;
+    vector<hbv_cache_key> keys(nSol);
+    vector<int> alive;
+    for(int i=0; i<nSol; i++){
+        if(cache != NULL){
+            keys[i] = cache->makeKey(&vars[i*nvars]);
+            if(cache->lookup(keys[i], &objs[i*nobjs])) continue;
+        }
+        alive.push_back(i);
+    }
+    candidates += alive.size();
+
+    // state and flows of each candidate at the end of the last stage
+    vector<hbv_snapshot> snapshots(nSol);
+    vector<vector<double> > traces(nSol);
+    vector<double> score(nSol);
+
+    int first = 1;
+    for(unsigned int k=0; k<=stages.size(); k++){
+        bool last = k == stages.size();
+        int end = last ? nDays : stages[k].step;
+
+        parallel(alive.size(), [&, k, last, first, end](hbv_model *model, int a){
+            int i = alive[a];
+            double *Qsim = model->getFluxes().Qsim;
+            chrono::steady_clock::time_point t0 = hbv_stats::start();
+            model->start((double*)&vars[i*nvars]);
+            if(k > 0){
+                model->loadState(snapshots[i]);
+                copy(traces[i].begin(), traces[i].end(), Qsim);
+            }
+            model->run(first, end);
+
+            if(last){
+                metrics->evaluate(hbv_span(Qsim, nDays), &objs[i*nobjs]);
+                hbv_stats::evaluation(t0, end - first);
+                if(cache != NULL) cache->insert(keys[i], &objs[i*nobjs], Qsim, nDays);
+                return;
+            }
+            stages[k].metric->evaluate(hbv_span(Qsim, end), &score[i]);
+            // undefined scores (e.g. r of a constant flow over a short stage)
+            // are the worst ones, so that the promotion rules can compare them
+            if(!(fabs(score[i]) <= numeric_limits<double>::max())) score[i] = HUGE_VAL;
+            hbv_stats::add(hbv_stats::timeSteps, end - first);
+            model->saveState(snapshots[i]);
+            traces[i].assign(Qsim, Qsim+end);
+        });
+        simulated += (long)alive.size()*(end - first);
+        if(last) break;
+
+        // promotion rule
+        vector<int> promoted;
+        if(stages[k].best){
+            vector<int> order(alive);
+            sort(order.begin(), order.end(), [&score](int a, int b){ return score[a] < score[b]; });
+            int n = max(1, (int)ceil(stages[k].value*order.size()));
+            vector<bool> keep(nSol, false);
+            for(int a=0; a<n && a<(int)order.size(); a++) keep[order[a]] = true;
+            for(unsigned int a=0; a<alive.size(); a++) if(keep[alive[a]]) promoted.push_back(alive[a]);
+        }else{
+            for(unsigned int a=0; a<alive.size(); a++){
+                if(score[alive[a]] <= stages[k].value) promoted.push_back(alive[a]);
+            }
+        }
+
+        // eliminated candidates are never preferred to the completed ones
+        vector<bool> promotedFlag(nSol, false);
+        for(unsigned int a=0; a<promoted.size(); a++) promotedFlag[promoted[a]] = true;
+        for(unsigned int a=0; a<alive.size(); a++){
+            int i = alive[a];
+            if(promotedFlag[i]) continue;
+            for(int m=0; m<nobjs; m++) objs[i*nobjs+m] = numeric_limits<double>::max();
+            snapshots[i] = hbv_snapshot();
+            vector<double>().swap(traces[i]);
+        }
+        eliminated[k] += alive.size() - promoted.size();
+        hbv_stats::add(hbv_stats::aborted, alive.size() - promoted.size());
+        saved += (long)(alive.size() - promoted.size())*(nDays - end);
+        alive.swap(promoted);
+        first = end;
+    }
+}
+
+
+void hbv_race::printStatistics(ostream &out)
+{
+    out << "race: " << candidates << " candidates";
+    for(unsigned int k=0; k<stages.size(); k++){
+        out << ", " << eliminated[k] << " eliminated after " << stages[k].step << " time steps";
+    }
+    out << "; " << simulated << " time steps simulated, " << saved << " saved ("
+        << (simulated+saved > 0 ? 100.0*saved/(simulated+saved) : 0.0) << "%)" << endl;
+}
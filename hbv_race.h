@@ -0,0 +1,80 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_RACE_H
+#define HBV_RACE_H
+
+#include "hbv_pool.h"
+#include <vector>
+#include <string>
+
+namespace std{
+
+/**
+ * stage of a race: at the end of the first `step` time steps, the candidates
+ * are scored with a metric on that sub-period and only those satisfying the
+ * rule continue (score <= value, or the best fraction `value` of them)
+ */
+struct race_stage
+{
+    int step;
+    hbv_metrics *metric;
+    bool best;
+    double value;
+};
+
+/**
+ * Multi-fidelity evaluation of a batch: the candidates are simulated stage
+ * by stage over nested sub-periods of the record, and after each stage only
+ * the promising ones are continued, from the state saved at the end of the
+ * previous stage. The candidates completing the race have the same
+ * objectives as a full run, the eliminated ones have the largest
+ * objectives (they are never preferred to a completed one).
+ * Stages are given as DAYS:METRIC:max:VALUE or DAYS:METRIC:best:FRACTION
+ * (comma-separated, in increasing order of DAYS).
+ */
+class hbv_race : public hbv_pool
+{
+public:
+
+    hbv_race(hbv_model *base, hbv_metrics *metrics, string stages, int nThreads);
+    virtual ~hbv_race();
+
+    void evaluate(int nSol, const double *vars, double *objs);
+
+    /**
+     * candidates eliminated at each stage and simulated time steps
+     */
+    virtual void printStatistics(ostream &out);
+
+protected:
+
+    vector<race_stage> stages;
+    int nDays;
+
+    // statistics
+    long candidates;
+    vector<long> eliminated;
+    long simulated;     // time steps simulated
+    long saved;         // time steps not simulated thanks to the race
+
+};
+}
+
+#endif // HBV_RACE_H
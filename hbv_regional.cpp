@@ -0,0 +1,153 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "hbv_regional.h"
+#include "hbv_monitor.h"
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+using namespace std;
+
+hbv_regional::hbv_regional(string manifest, string objectives, string aggregate, int nThreads)
+    : scheduler(nThreads, false)
+{
+    if(aggregate == "mean") this->aggregate = MEAN;
+    else if(aggregate == "worst") this->aggregate = WORST;
+    else if(aggregate == "all") this->aggregate = ALL;
+    else{
+        cout << "Unknown aggregation " << aggregate << " (mean, worst or all)" << endl;
+        exit(1);
+    }
+
+    ifstream in(manifest.c_str(), ios::in);
+    if(!in){
+        cout << "The manifest specified: " << manifest << " could not be found!" << endl;
+        exit(1);
+    }
+    string line, file;
+    while(getline(in, line)){
+        stringstream ss(line);
+        if(!(ss >> file) || file[0] == '#') continue;
+        double w = 1.0;
+        if(ss >> w && w < 0.0){
+            cout << "Invalid weight of the catchment " << file << endl;
+            exit(1);
+        }
+        forcingFiles.push_back(file);
+        weights.push_back(w);
+    }
+    if(forcingFiles.empty()){
+        cout << "The manifest " << manifest << " lists no catchment" << endl;
+        exit(1);
+    }
+    double sum = 0.0;
+    for(unsigned int k=0; k<weights.size(); k++) sum += weights[k];
+    for(unsigned int k=0; k<weights.size(); k++) weights[k] = sum > 0.0 ? weights[k]/sum : 1.0/weights.size();
+
+    // forcing data and observations of each catchment (only the flows are needed)
+    int K = forcingFiles.size();
+    for(int k=0; k<K; k++){
+        base.push_back(new hbv_model(forcingFiles[k]));
+        base[k]->setStoreStates(false);
+        hbv_span Qobs(base[k]->getData().flow, base[k]->getData().nDays);
+        hbv_span precip(base[k]->getData().precip, base[k]->getData().nDays);
+        metrics.push_back(new hbv_metrics(objectives, Qobs, precip, base[k]->getWarmup()));
+    }
+    nobjs = metrics[0]->size();
+
+    order.resize(K);
+    for(int k=0; k<K; k++) order[k] = k;
+    stable_sort(order.begin(), order.end(), [this](int a, int b){
+        return base[a]->getData().nDays*base[a]->getData().nZones > base[b]->getData().nDays*base[b]->getData().nZones;
+    });
+
+    // each thread simulates with its own states, sharing the forcing
+    models.push_back(base);
+    for(int t=1; t<scheduler.getNumberOfThreads(); t++){
+        models.push_back(vector<hbv_model*>());
+        for(int k=0; k<K; k++){
+            models[t].push_back(new hbv_model(base[k]));
+            models[t][k]->setStoreStates(false);
+        }
+    }
+}
+
+hbv_regional::~hbv_regional()
+{
+    for(unsigned int t=0; t<models.size(); t++){
+        for(unsigned int k=0; k<models[t].size(); k++){
+            models[t][k]->hbv_delete(models[t][k]->getData().nDays);
+            if(t > 0) delete models[t][k];
+        }
+    }
+    for(unsigned int k=0; k<base.size(); k++){
+        delete base[k];
+        delete metrics[k];
+    }
+}
+
+int hbv_regional::getNumberOfObjectives()
+{
+    return aggregate == ALL ? nobjs*base.size() : nobjs;
+}
+
+int hbv_regional::getNumberOfCatchments()
+{
+    return base.size();
+}
+
+
+void hbv_regional::evaluate(int nSol, const double *vars, double *objs)
+{
+    int K = base.size();
+    catchmentObjs.resize((size_t)nSol*K*nobjs);
+
+    // task i*K + j is the run of parameter set i on the j-th longest catchment
+    vector<int> tasks(nSol*K);
+    for(int i=0; i<nSol*K; i++) tasks[i] = i;
+    scheduler.run(tasks, [this, vars, K](int thread, int id){
+        int i = id / K;
+        int k = order[id % K];
+        hbv_model *model = models[thread][k];
+        int nDays = model->getData().nDays;
+        chrono::steady_clock::time_point t0 = hbv_stats::start();
+        model->calc_HBV((double*)&vars[i*hbv_model::nParams]);
+        metrics[k]->evaluate(hbv_span(model->getFluxes().Qsim, nDays), &catchmentObjs[((size_t)i*K + k)*nobjs]);
+        hbv_stats::evaluation(t0, nDays);
+    });
+
+    for(int i=0; i<nSol; i++){
+        const double *c = &catchmentObjs[(size_t)i*K*nobjs];
+        if(aggregate == ALL){
+            copy(c, c + K*nobjs, &objs[(size_t)i*K*nobjs]);
+            continue;
+        }
+        for(int m=0; m<nobjs; m++){
+            double value = aggregate == MEAN ? 0.0 : c[m];
+            for(int k=0; k<K; k++){
+                if(aggregate == MEAN) value += weights[k]*c[k*nobjs+m];
+                else value = max(value, c[k*nobjs+m]);
+            }
+            objs[i*nobjs+m] = value;
+        }
+    }
+}
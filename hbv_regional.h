@@ -0,0 +1,71 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_REGIONAL_H
+#define HBV_REGIONAL_H
+
+#include "hbv_pool.h"
+#include "hbv_scheduler.h"
+#include <vector>
+#include <string>
+
+namespace std{
+
+/**
+ * Regional evaluation of parameter sets shared by several catchments, listed
+ * in a manifest with one line per catchment:
+ *   forcing_file [weight]
+ * Every parameter set is simulated on all the catchments, the (parameter set
+ * x catchment) runs being spread over the threads (longest records first),
+ * and the objectives of the catchments are aggregated as their weighted
+ * mean ("mean", default weight 1), their worst value ("worst", i.e. the
+ * largest since all the objectives are minimized) or kept as a vector of
+ * catchments x objectives ("all", catchment by catchment).
+ */
+class hbv_regional : public hbv_evaluator
+{
+public:
+
+    hbv_regional(string manifest, string objectives, string aggregate, int nThreads);
+    virtual ~hbv_regional();
+
+    void evaluate(int nSol, const double *vars, double *objs);
+    int getNumberOfObjectives();
+
+    int getNumberOfCatchments();
+
+protected:
+
+    enum { MEAN, WORST, ALL } aggregate;
+
+    vector<string> forcingFiles;
+    vector<double> weights;     // normalized to sum 1
+    vector<hbv_model*> base;    // one per catchment
+    vector<hbv_metrics*> metrics;
+    vector<int> order;          // catchments by decreasing record length
+    int nobjs;                  // objectives of each catchment
+
+    hbv_scheduler scheduler;
+    vector<vector<hbv_model*> > models; // [thread][catchment], thread 0 uses the base models
+    vector<double> catchmentObjs;       // nSol x catchments x nobjs
+
+};
+}
+
+#endif // HBV_REGIONAL_H
@@ -0,0 +1,190 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_sampling.h"
+#include <iostream>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+// Joe and Kuo (2008) direction numbers, dimensions 2-12: s, a, m_1..m_s
+const unsigned int hbv_design::sobolTable[maxSobolDims-1][7] = {
+    {1,  0, 1},
+    {2,  1, 1, 3},
+    {3,  1, 1, 3, 1},
+    {3,  2, 1, 1, 1},
+    {4,  1, 1, 1, 3, 3},
+    {4,  4, 1, 3, 5, 13},
+    {5,  2, 1, 1, 5, 5, 17},
+    {5,  4, 1, 1, 5, 5, 5},
+    {5,  7, 1, 1, 7, 11, 19},
+    {5, 11, 1, 1, 5, 1, 1},
+    {5, 13, 1, 1, 1, 3, 11}
+};
+
+hbv_design::hbv_design(string type, int nvars, const double *lb, const double *ub, long nSamples, unsigned int seed)
+{
+    this->nvars = nvars;
+    this->nSamples = nSamples;
+    this->seed = seed;
+    this->lb = new double[nvars];
+    range = new double[nvars];
+    for(int j=0; j<nvars; j++){
+        this->lb[j] = lb[j];
+        range[j] = ub[j] - lb[j];
+    }
+    matrix = NULL;
+    mapSize = 0;
+
+    if((type == "lhs" || type == "sobol") && (nSamples <= 0 || nSamples > 4294967296L)){
+        cout << "The number of samples of the design must be between 1 and 2^32" << endl;
+        exit(1);
+    }
+
+    if(type == "lhs"){
+        this->type = LHS;
+        halfBits = 1;
+        while((1ULL << (2*halfBits)) < (uint64_t)nSamples) halfBits++;
+    }else if(type == "sobol"){
+        this->type = SOBOL;
+        if(nvars > maxSobolDims){
+            cout << "The Sobol sequence is available up to " << maxSobolDims << " dimensions" << endl;
+            exit(1);
+        }
+        // first dimension: van der Corput sequence
+        for(int k=0; k<32; k++) direction[0][k] = 1U << (31-k);
+        for(int j=1; j<nvars; j++){
+            const unsigned int *t = sobolTable[j-1];
+            unsigned int s = t[0], a = t[1];
+            for(unsigned int k=0; k<32; k++){
+                if(k < s){
+                    direction[j][k] = t[2+k] << (31-k);
+                }else{
+                    uint32_t v = direction[j][k-s] ^ (direction[j][k-s] >> s);
+                    for(unsigned int i=1; i<s; i++){
+                        if((a >> (s-1-i)) & 1) v ^= direction[j][k-i];
+                    }
+                    direction[j][k] = v;
+                }
+            }
+        }
+    }else{
+        this->type = MATRIX;
+        int fd = open(type.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) != 0){
+            cout << "The design file specified: " << type << " could not be found!" << endl;
+            exit(1);
+        }
+        mapSize = st.st_size;
+        if(mapSize == 0 || mapSize % (nvars*sizeof(double)) != 0){
+            cout << "The design file " << type << " is not a binary matrix of " << nvars << " columns" << endl;
+            exit(1);
+        }
+        void *p = mmap(NULL, mapSize, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if(p == MAP_FAILED){
+            cout << "The design file " << type << " could not be mapped" << endl;
+            exit(1);
+        }
+        madvise(p, mapSize, MADV_SEQUENTIAL);
+        matrix = (const double*)p;
+        this->nSamples = mapSize / (nvars*sizeof(double));
+    }
+}
+
+hbv_design::~hbv_design()
+{
+    if(matrix != NULL) munmap((void*)matrix, mapSize);
+    delete[] lb;
+    delete[] range;
+}
+
+long hbv_design::size()
+{
+    return nSamples;
+}
+
+
+void hbv_design::get(long row, double *vars)
+{
+    switch(type){
+    case LHS:
+        for(int j=0; j<nvars; j++){
+            double u = (permute(row, j) + jitter(row, j)) / nSamples;
+            vars[j] = lb[j] + u*range[j];
+        }
+        break;
+    case SOBOL:
+        {
+            // direct evaluation of the Gray code point
+            uint32_t gray = (uint32_t)(row ^ (row >> 1));
+            for(int j=0; j<nvars; j++){
+                uint32_t x = 0;
+                for(int k=0; gray >> k; k++){
+                    if((gray >> k) & 1) x ^= direction[j][k];
+                }
+                vars[j] = lb[j] + (x / 4294967296.0)*range[j];
+            }
+        }
+        break;
+    case MATRIX:
+        for(int j=0; j<nvars; j++) vars[j] = matrix[row*nvars+j];
+        break;
+    }
+}
+
+
+uint64_t hbv_design::hash(uint64_t a, uint64_t b, uint64_t c)
+{
+    // splitmix64 finalizer of the combined inputs
+    uint64_t z = a*0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL)*0xBF58476D1CE4E5B9ULL ^ c*0x94D049BB133111EBULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+
+uint64_t hbv_design::permute(uint64_t i, int dim)
+{
+    // balanced Feistel network on 2*halfBits bits is a bijection; values
+    // outside [0, nSamples) are mapped again (cycle walking)
+    uint64_t mask = (1ULL << halfBits) - 1;
+    do{
+        uint64_t left = i >> halfBits, right = i & mask;
+        for(int round=0; round<4; round++){
+            uint64_t f = hash(seed, dim*4 + round, right) & mask;
+            uint64_t t = right;
+            right = left ^ f;
+            left = t;
+        }
+        i = (left << halfBits) | right;
+    }while(i >= (uint64_t)nSamples);
+    return i;
+}
+
+
+double hbv_design::jitter(uint64_t i, int dim)
+{
+    // position inside the stratum, 53 random bits
+    return (hash(~seed, dim, i) >> 11) * (1.0/9007199254740992.0);
+}
@@ -0,0 +1,84 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_SAMPLING_H
+#define HBV_SAMPLING_H
+
+#include <string>
+#include <stdint.h>
+
+namespace std{
+
+/**
+ * Experimental design for bulk (Monte Carlo) runs. Rows are generated on
+ * demand and independently of each other, so that separate processes can
+ * evaluate disjoint ranges of the same design without coordination:
+ *  - "lhs": Latin hypercube, each column is a pseudo-random permutation of
+ *    the strata (keyed Feistel network) with a random position in the stratum
+ *  - "sobol": Sobol sequence (Joe and Kuo direction numbers, up to 12
+ *    dimensions), starting from the origin
+ *  - otherwise, the name of a binary file of nSamples x nvars doubles (native
+ *    byte order, row-major) mapped in memory
+ */
+class hbv_design
+{
+public:
+
+    hbv_design(string type, int nvars, const double *lb, const double *ub, long nSamples, unsigned int seed);
+    virtual ~hbv_design();
+
+    /**
+     * number of rows
+     */
+    long size();
+
+    /**
+     * parameter set of a row
+     */
+    void get(long row, double *vars);
+
+protected:
+
+    enum { LHS, SOBOL, MATRIX } type;
+
+    // LHS
+    uint64_t permute(uint64_t i, int dim);
+    double jitter(uint64_t i, int dim);
+    uint64_t hash(uint64_t a, uint64_t b, uint64_t c);
+    int halfBits;       // the Feistel network works on 2*halfBits bits
+
+    // Sobol
+    static const int maxSobolDims = 12;
+    static const unsigned int sobolTable[maxSobolDims-1][7];
+    uint32_t direction[maxSobolDims][32];
+
+    // binary matrix
+    const double *matrix;
+    size_t mapSize;
+
+    int nvars;
+    long nSamples;
+    uint64_t seed;
+    double *lb;
+    double *range;
+
+};
+}
+
+#endif // HBV_SAMPLING_H
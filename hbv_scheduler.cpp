@@ -0,0 +1,163 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_scheduler.h"
+#include "hbv_monitor.h"
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+hbv_scheduler::hbv_scheduler(int nThreads, bool affinity)
+{
+    this->nThreads = nThreads > 0 ? nThreads : max((int)thread::hardware_concurrency(), 1);
+    this->affinity = affinity;
+    for(int i=0; i<this->nThreads; i++) queues.push_back(new task_queue());
+    pending = 0;
+    steals = 0;
+    version = 0;
+    stopping = false;
+    current = NULL;
+
+    for(int t=0; t<this->nThreads; t++){
+        threads.push_back(thread(&hbv_scheduler::worker, this, t));
+#ifdef __linux__
+        if(affinity){
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(t % max((int)thread::hardware_concurrency(), 1), &cpus);
+            pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpu_set_t), &cpus);
+        }
+#endif
+    }
+}
+
+hbv_scheduler::~hbv_scheduler()
+{
+    {
+        lock_guard<mutex> lock(stateLock);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(unsigned int t=0; t<threads.size(); t++) threads[t].join();
+    for(unsigned int i=0; i<queues.size(); i++) delete queues[i];
+}
+
+int hbv_scheduler::getNumberOfThreads()
+{
+    return nThreads;
+}
+
+long hbv_scheduler::getSteals()
+{
+    return steals;
+}
+
+
+void hbv_scheduler::run(const vector<int> &tasks, const function<void(int, int)> &task)
+{
+    int n = tasks.size();
+    if(n == 0) return;
+    current = &task;
+    pending = n;
+    hbv_stats::set(hbv_stats::queueDepth, n);
+    for(int t=0; t<nThreads; t++){
+        lock_guard<mutex> lock(queues[t]->lock);
+        for(int i=(long)n*t/nThreads; i<(long)n*(t+1)/nThreads; i++){
+            queues[t]->tasks.push_back(tasks[i]);
+        }
+    }
+    queued();
+
+    unique_lock<mutex> lock(stateLock);
+    done.wait(lock, [this]{ return pending == 0; });
+}
+
+
+void hbv_scheduler::spawn(int thread, int id)
+{
+    hbv_stats::set(hbv_stats::queueDepth, ++pending);
+    {
+        lock_guard<mutex> lock(queues[thread]->lock);
+        queues[thread]->tasks.push_front(id);
+    }
+    queued();
+}
+
+
+void hbv_scheduler::queued()
+{
+    {
+        lock_guard<mutex> lock(stateLock);
+        version++;
+    }
+    wake.notify_all();
+}
+
+
+void hbv_scheduler::worker(int id)
+{
+    int t;
+    while(true){
+        // pushes after this point wake the thread up even if it has not
+        // started to wait yet
+        unique_lock<mutex> lock(stateLock);
+        long seen = version;
+        if(stopping) return;
+        lock.unlock();
+
+        while(pop(id, t) || steal(id, t)){
+            (*current)(id, t);
+            long left = --pending;
+            hbv_stats::set(hbv_stats::queueDepth, left);
+            if(left == 0){
+                lock_guard<mutex> last(stateLock);
+                done.notify_all();
+            }
+        }
+
+        lock.lock();
+        wake.wait(lock, [this, seen]{ return stopping || version != seen; });
+    }
+}
+
+
+bool hbv_scheduler::pop(int id, int &task)
+{
+    lock_guard<mutex> lock(queues[id]->lock);
+    if(queues[id]->tasks.empty()) return false;
+    task = queues[id]->tasks.front();
+    queues[id]->tasks.pop_front();
+    return true;
+}
+
+
+bool hbv_scheduler::steal(int id, int &task)
+{
+    for(int k=1; k<nThreads; k++){
+        task_queue *victim = queues[(id + k) % nThreads];
+        lock_guard<mutex> lock(victim->lock);
+        if(victim->tasks.empty()) continue;
+        task = victim->tasks.back();
+        victim->tasks.pop_back();
+        steals++;
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,95 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_SCHEDULER_H
+#define HBV_SCHEDULER_H
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <functional>
+
+namespace std{
+
+/**
+ * Work-stealing thread pool: each thread owns a queue of tasks (integers
+ * interpreted by the caller), takes its own tasks from the front and, when
+ * it runs out of work, steals from the back of the queue of another thread.
+ * Tasks can spawn new tasks, which are queued on the thread running them.
+ * The threads are created once (pinned to the cores on Linux, so that the
+ * data of the tasks of a queue stay in the caches of the same core) and
+ * sleep on a condition variable when there is nothing to pop or steal, so
+ * successive runs do not create threads and idle threads do not spin.
+ */
+class hbv_scheduler
+{
+public:
+
+    hbv_scheduler(int nThreads, bool affinity);
+    virtual ~hbv_scheduler();
+
+    /**
+     * run the tasks (split in contiguous blocks among the threads, in the
+     * given order) and those they spawn, calling task(thread, id)
+     */
+    void run(const vector<int> &tasks, const function<void(int, int)> &task);
+
+    /**
+     * queue a new task on a thread (to be called from a running task)
+     */
+    void spawn(int thread, int id);
+
+    int getNumberOfThreads();
+    long getSteals();
+
+protected:
+
+    struct task_queue
+    {
+        mutex lock;
+        deque<int> tasks;
+    };
+
+    void worker(int id);
+    bool pop(int id, int &task);
+    bool steal(int id, int &task);
+    void queued();          // wake the sleeping threads after a push
+
+    int nThreads;
+    bool affinity;
+    vector<task_queue*> queues;
+    vector<thread> threads;
+    atomic<long> pending;   // tasks queued or running
+    atomic<long> steals;
+
+    // sleeping threads and end of a run
+    mutex stateLock;
+    condition_variable wake;    // tasks queued or stop
+    condition_variable done;    // pending == 0
+    long version;           // number of pushes (under stateLock)
+    bool stopping;
+    const function<void(int, int)> *current;    // task function of the run
+
+};
+}
+
+#endif // HBV_SCHEDULER_H
@@ -0,0 +1,147 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_signatures.h"
+#include <math.h>
+#include <algorithm>
+
+using namespace std;
+
+const char *hbv_signatures::names[hbv_signatures::NSIGNATURES] = {
+    "runoff_ratio", "bfi", "recession", "fdc_slope", "q5", "q95"
+};
+
+hbv_signatures::hbv_signatures(hbv_span Qobs, hbv_span precip, int warmup){
+
+    this->warmup = warmup;
+    n = max(Qobs.size - warmup, 0);
+    filterAlpha = 0.925;
+
+    // observed days and total precipitation on those days
+    valid.resize(n);
+    totalPrecip = 0.0;
+    for(int i=0; i<n; i++){
+        valid[i] = Qobs.data[warmup+i] >= 0.0;
+        if(valid[i] && precip.data != NULL) totalPrecip += precip.data[warmup+i];
+    }
+
+    // observed signatures and flow duration curve (sorted once)
+    observed.resize(NSIGNATURES);
+    streamingSignatures(Qobs.data + warmup, &observed[0]);
+    for(int i=0; i<n; i++){
+        if(valid[i]) fdcObs.push_back(Qobs.data[warmup+i]);
+    }
+    sort(fdcObs.begin(), fdcObs.end());
+    if(!fdcObs.empty()){
+        observed[FDC_SLOPE] = (logFlow(quantile(fdcObs, 0.66)) - logFlow(quantile(fdcObs, 0.33)))/(0.66 - 0.33);
+        observed[Q5] = quantile(fdcObs, 0.95);
+        observed[Q95] = quantile(fdcObs, 0.05);
+    }
+}
+
+hbv_signatures::~hbv_signatures(){
+}
+
+double hbv_signatures::getObserved(int i){
+    return observed[i];
+}
+
+const vector<double> &hbv_signatures::getObservedFDC(){
+    return fdcObs;
+}
+
+double hbv_signatures::logFlow(double q){
+    // zero flows are bounded to 0.001 mm
+    return log(max(q, 1.0e-3));
+}
+
+double hbv_signatures::quantile(const vector<double> &sorted, double p){
+    return sorted[int(p*(sorted.size()-1))];
+}
+
+
+void hbv_signatures::streamingSignatures(const double *q, double *sig){
+
+    double total = 0.0, baseflow = 0.0;
+    double quick = 0.0, qPrev = -1.0;
+    double sumLogRatio = 0.0;
+    int nRecession = 0;
+    double a = filterAlpha;
+
+    for(int i=0; i<n; i++){
+        if(!valid[i]) continue;
+        double qt = q[i];
+        total += qt;
+
+        // Lyne-Hollick filter: quickflow is filtered from the flow increments
+        if(qPrev >= 0.0){
+            quick = a*quick + 0.5*(1.0 + a)*(qt - qPrev);
+            quick = min(max(quick, 0.0), qt);
+        }
+        baseflow += qt - quick;
+
+        // recession days: decreasing flow
+        if(qPrev > 0.0 && qt > 0.0 && qt < qPrev){
+            sumLogRatio += log(qt/qPrev);
+            nRecession++;
+        }
+        qPrev = qt;
+    }
+
+    sig[RUNOFF_RATIO] = totalPrecip > 0.0 ? total/totalPrecip : 0.0;
+    sig[BFI] = total > 0.0 ? baseflow/total : 0.0;
+    sig[RECESSION] = nRecession > 0 ? exp(sumLogRatio/nRecession) : 0.0;
+}
+
+
+void hbv_signatures::quantileSignatures(double *values, int m, double *sig){
+
+    if(m == 0) return;
+
+    // selection of the 95th, 66th, 33rd and 5th percentiles: each
+    // nth_element only reorders the part below the previous one
+    int k95 = int(0.95*(m-1));
+    int k66 = int(0.66*(m-1));
+    int k33 = int(0.33*(m-1));
+    int k05 = int(0.05*(m-1));
+    nth_element(values, values + k95, values + m);
+    nth_element(values, values + k66, values + k95);
+    nth_element(values, values + k33, values + k66);
+    nth_element(values, values + k05, values + k33);
+
+    // flow duration curve slope between 33% and 66% exceedance (Sawicz et al., 2011)
+    sig[FDC_SLOPE] = (logFlow(values[k66]) - logFlow(values[k33]))/(0.66 - 0.33);
+    sig[Q5] = values[k95];
+    sig[Q95] = values[k05];
+}
+
+
+void hbv_signatures::compute(hbv_span Qsim, double *sig){
+
+    const double *q = Qsim.data + warmup;
+    streamingSignatures(q, sig);
+
+    // per-thread buffer for the selection of the quantiles
+    static thread_local vector<double> values;
+    values.resize(n);
+    int m = 0;
+    for(int i=0; i<n; i++){
+        if(valid[i]) values[m++] = q[i];
+    }
+    quantileSignatures(&values[0], m, sig);
+}
@@ -0,0 +1,81 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HBV_SIGNATURES_H
+#define HBV_SIGNATURES_H
+
+#include "hbv_metrics.h"
+#include <vector>
+#include <string>
+
+namespace std{
+
+/**
+ * hydrologic signatures of a flow series (after the warm-up):
+ *  - runoff ratio (total flow / total precipitation)
+ *  - baseflow index, with a single-pass Lyne-Hollick digital filter
+ *  - recession constant (geometric mean of Q(t)/Q(t-1) on recession days)
+ *  - slope of the flow duration curve between 33% and 66% exceedance
+ *  - high (5% exceedance) and low (95% exceedance) flow percentiles
+ * The quantiles are found by selection (nth_element) instead of a full
+ * sort; the observed flow duration curve is sorted once and cached.
+ * Days with missing (negative) observations are skipped.
+ */
+class hbv_signatures
+{
+public:
+
+    enum signature { RUNOFF_RATIO, BFI, RECESSION, FDC_SLOPE, Q5, Q95, NSIGNATURES };
+    static const char *names[NSIGNATURES];
+
+    hbv_signatures(hbv_span Qobs, hbv_span precip, int warmup);
+    virtual ~hbv_signatures();
+
+    /**
+     * signatures of a simulated series (whole record)
+     */
+    void compute(hbv_span Qsim, double *sig);
+
+    /**
+     * signatures of the observations and their flow duration curve
+     * (ascending order)
+     */
+    double getObserved(int i);
+    const vector<double> &getObservedFDC();
+
+protected:
+
+    // one pass on the series: totals, baseflow filter and recessions
+    void streamingSignatures(const double *q, double *sig);
+    // flow duration curve slope and percentiles of the values (reordered)
+    void quantileSignatures(double *values, int n, double *sig);
+    static double quantile(const vector<double> &sorted, double p);
+    static double logFlow(double q);
+
+    int warmup;
+    int n;
+    vector<char> valid;
+    double totalPrecip;
+    double filterAlpha;
+    vector<double> observed;
+    vector<double> fdcObs;
+
+};
+}
+
+#endif // HBV_SIGNATURES_H
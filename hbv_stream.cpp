@@ -0,0 +1,291 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#include "hbv_stream.h"
+#include <iostream>
+#include <cstdlib>
+#include <limits>
+
+using namespace std;
+
+hbv_forcing_reader::hbv_forcing_reader(string filename, hbv_model *model)
+{
+    this->filename = filename;
+    tempData = model->getData().tempData;
+    hourly = model->getTimeStep() < 24*3600;
+    skip = model->getStreamFirst();
+    nSteps = model->getStreamSteps();
+    open();
+}
+
+hbv_forcing_reader::hbv_forcing_reader(const hbv_forcing_reader &reader)
+{
+    filename = reader.filename;
+    tempData = reader.tempData;
+    hourly = reader.hourly;
+    skip = reader.skip;
+    nSteps = reader.nSteps;
+    open();
+}
+
+hbv_forcing_reader::~hbv_forcing_reader()
+{
+    in.close();
+}
+
+void hbv_forcing_reader::open()
+{
+    in.open(filename.c_str(), ios::in);
+    if(!in){
+        cout << "The input file specified: " << filename << " could not be found!" << endl;
+        exit(1);
+    }
+    // the data start on the line after the <DATA_START> key
+    string key;
+    while(in >> key && key != "<DATA_START>");
+    in.ignore(numeric_limits<streamsize>::max(), '\n');
+    dataStart = in.tellg();
+    rewind();
+}
+
+long hbv_forcing_reader::size()
+{
+    return nSteps;
+}
+
+hbv_forcing_source *hbv_forcing_reader::clone()
+{
+    return new hbv_forcing_reader(*this);
+}
+
+void hbv_forcing_reader::rewind()
+{
+    in.clear();
+    in.seekg(dataStart);
+    pending.clear();
+    for(int i=0; i<skip; i++) getline(in, line);
+    remaining = nSteps;
+}
+
+
+bool hbv_forcing_reader::next(forcing_step &s)
+{
+    if(!pending.empty()){
+        s = pending.front();
+        pending.pop_front();
+        return true;
+    }
+    if(remaining <= 0) return false;
+
+    // year month day [hour] precip flow temp|(max min), blank lines are skipped
+    int nCols = (hourly ? 4 : 3) + 2 + tempData;
+    double v[8];
+    int n = 0;
+    while(n == 0){
+        if(!getline(in, line)){
+            cout << "The input file " << filename << " has less than " << nSteps << " time steps" << endl;
+            exit(1);
+        }
+        const char *p = line.c_str();
+        char *end;
+        for(n=0; n<nCols; n++){
+            v[n] = strtod(p, &end);
+            if(end == p) break;
+            p = end;
+        }
+        if(n > 0 && n < nCols){
+            cout << "Invalid line of the input file " << filename << ": " << line << endl;
+            exit(1);
+        }
+    }
+    remaining--;
+
+    for(int k=0; k<3; k++) s.date[k] = int(v[k]);
+    s.date[3] = hourly ? int(v[3]) : 0;
+    int c = hourly ? 4 : 3;
+    s.precip = v[c];
+    s.temp = tempData > 1 ? (v[c+2] + v[c+3])/2.0 : v[c+2];
+    return true;
+}
+
+
+int hbv_forcing_reader::read(int maxSteps, int *date, double *precip, double *temp)
+{
+    forcing_step s;
+    int n = 0;
+    while(n < maxSteps && next(s)){
+        for(int k=0; k<4; k++) date[4*n+k] = s.date[k];
+        precip[n] = s.precip;
+        temp[n] = s.temp;
+        n++;
+    }
+
+    // the time steps of an incomplete day are read again with the next chunk
+    if(n == maxSteps && next(s)){
+        pending.push_front(s);
+        int k = n;
+        while(k > 0 && date[4*(k-1)] == s.date[0] && date[4*(k-1)+1] == s.date[1] && date[4*(k-1)+2] == s.date[2]) k--;
+        if(k == 0){
+            cout << "The chunks must hold at least one day of data" << endl;
+            exit(1);
+        }
+        for(int i=n-1; i>=k; i--){
+            for(int j=0; j<4; j++) s.date[j] = date[4*i+j];
+            s.precip = precip[i];
+            s.temp = temp[i];
+            pending.push_front(s);
+        }
+        n = k;
+    }
+    return n;
+}
+
+
+hbv_weather_generator::hbv_weather_generator(hbv_model *historical, long years, unsigned int seed)
+{
+    if(historical->getTimeStep() != 24*3600){
+        cout << "The weather generator needs daily forcing data" << endl;
+        exit(1);
+    }
+    MyData data = historical->getData();
+    int first = historical->getStartingIndex();
+
+    // transitions, wet-day amounts and temperatures of each calendar month
+    double n0[12], n01[12], n1[12], n11[12];
+    double nWet[12], sumP[12], sumP2[12];
+    double nT[12], sumT[12], sumT2[12];
+    for(int m=0; m<12; m++){
+        n0[m] = n01[m] = n1[m] = n11[m] = 0.0;
+        nWet[m] = sumP[m] = sumP2[m] = 0.0;
+        nT[m] = sumT[m] = sumT2[m] = 0.0;
+    }
+    for(int t=first; t<data.nDays; t++){
+        int m = data.date[t][1] - 1;
+        double P = data.precip[t];
+        bool w = P > 0.1;
+        if(t > first && data.precip[t-1] >= 0.0 && P >= 0.0){
+            if(data.precip[t-1] > 0.1){
+                n1[m]++;
+                if(w) n11[m]++;
+            }else{
+                n0[m]++;
+                if(w) n01[m]++;
+            }
+        }
+        if(w){
+            nWet[m]++;
+            sumP[m] += P;
+            sumP2[m] += P*P;
+        }
+        nT[m]++;
+        sumT[m] += data.avgTemp[t];
+        sumT2[m] += data.avgTemp[t]*data.avgTemp[t];
+    }
+    for(int m=0; m<12; m++){
+        p01[m] = n0[m] > 0.0 ? n01[m]/n0[m] : 0.0;
+        p11[m] = n1[m] > 0.0 ? n11[m]/n1[m] : 0.0;
+        double mean = nWet[m] > 0.0 ? sumP[m]/nWet[m] : 0.0;
+        double var = nWet[m] > 1.0 ? (sumP2[m] - nWet[m]*mean*mean)/(nWet[m] - 1.0) : 0.0;
+        // exponential distribution if the variance is not available
+        shape[m] = var > 0.0 ? mean*mean/var : 1.0;
+        scale[m] = var > 0.0 ? var/mean : max(mean, 1.0e-9);
+        tMean[m] = nT[m] > 0.0 ? sumT[m]/nT[m] : 0.0;
+        tStd[m] = nT[m] > 1.0 ? sqrt(max(sumT2[m] - nT[m]*tMean[m]*tMean[m], 0.0)/(nT[m] - 1.0)) : 0.0;
+    }
+
+    // lag-1 autocorrelation of the standardized anomalies
+    double num = 0.0, den = 0.0, zOld = 0.0;
+    for(int t=first; t<data.nDays; t++){
+        int m = data.date[t][1] - 1;
+        double z = tStd[m] > 0.0 ? (data.avgTemp[t] - tMean[m])/tStd[m] : 0.0;
+        if(t > first){
+            num += z*zOld;
+            den += zOld*zOld;
+        }
+        zOld = z;
+    }
+    phi = den > 0.0 ? max(min(num/den, 0.999), 0.0) : 0.0;
+
+    // from the first date of the record to the same date, years later
+    this->seed = seed;
+    for(int k=0; k<3; k++) firstDate[k] = data.date[first][k];
+    int d[3] = {firstDate[0], firstDate[1], firstDate[2]};
+    nSteps = 0;
+    while(d[0] < firstDate[0] + years || (d[0] == firstDate[0] + years &&
+          (d[1] < firstDate[1] || (d[1] == firstDate[1] && d[2] < firstDate[2])))){
+        nextDay(d);
+        nSteps++;
+    }
+    rewind();
+}
+
+long hbv_weather_generator::size()
+{
+    return nSteps;
+}
+
+hbv_forcing_source *hbv_weather_generator::clone()
+{
+    return new hbv_weather_generator(*this);
+}
+
+void hbv_weather_generator::rewind()
+{
+    rng.seed(seed);
+    for(int k=0; k<3; k++) date[k] = firstDate[k];
+    remaining = nSteps;
+    wet = false;
+    anomaly = 0.0;
+}
+
+void hbv_weather_generator::nextDay(int *date)
+{
+    static const int days[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    int y = date[0];
+    bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+    int length = date[1] == 2 && leap ? 29 : days[date[1]-1];
+    if(++date[2] > length){
+        date[2] = 1;
+        if(++date[1] > 12){
+            date[1] = 1;
+            date[0]++;
+        }
+    }
+}
+
+
+int hbv_weather_generator::read(int maxSteps, int *out, double *precip, double *temp)
+{
+    uniform_real_distribution<double> uniform(0.0, 1.0);
+    normal_distribution<double> normal(0.0, 1.0);
+    double innovation = sqrt(1.0 - phi*phi);
+    int n = 0;
+    for(; n<maxSteps && remaining>0; n++, remaining--){
+        int m = date[1] - 1;
+        wet = uniform(rng) < (wet ? p11[m] : p01[m]);
+        precip[n] = wet ? gamma_distribution<double>(shape[m], scale[m])(rng) : 0.0;
+        anomaly = phi*anomaly + innovation*normal(rng);
+        normal.reset();
+        temp[n] = tMean[m] + tStd[m]*anomaly;
+        for(int k=0; k<3; k++) out[4*n+k] = date[k];
+        out[4*n+3] = 0;
+        nextDay(date);
+    }
+    return n;
+}
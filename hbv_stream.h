@@ -0,0 +1,143 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_STREAM_H
+#define HBV_STREAM_H
+
+#include "hbv_model.h"
+#include <string>
+#include <fstream>
+#include <deque>
+#include <random>
+
+namespace std{
+
+/**
+ * source of forcing data read chunk by chunk (see hbv_model::loadForcing),
+ * so that the length of the series is not limited by the memory
+ */
+class hbv_forcing_source
+{
+public:
+    virtual ~hbv_forcing_source() {}
+
+    /**
+     * next whole days of forcing, at most maxSteps time steps: date (year,
+     * month, day, hour of each step), precipitation and mean temperature.
+     * Returns the number of time steps, 0 at the end of the series.
+     */
+    virtual int read(int maxSteps, int *date, double *precip, double *temp) = 0;
+
+    /**
+     * total number of time steps, and restart from the first one
+     */
+    virtual long size() = 0;
+    virtual void rewind() = 0;
+
+    /**
+     * independent source of the same series (e.g. one per thread)
+     */
+    virtual hbv_forcing_source *clone() = 0;
+};
+
+/**
+ * forcing of a data file (same format as hbv_model), read line by line
+ */
+class hbv_forcing_reader : public hbv_forcing_source
+{
+public:
+
+    hbv_forcing_reader(string filename, hbv_model *model);
+    hbv_forcing_reader(const hbv_forcing_reader &reader);
+    virtual ~hbv_forcing_reader();
+
+    int read(int maxSteps, int *date, double *precip, double *temp);
+    long size();
+    void rewind();
+    hbv_forcing_source *clone();
+
+protected:
+
+    struct forcing_step
+    {
+        int date[4];
+        double precip;
+        double temp;
+    };
+
+    void open();
+    bool next(forcing_step &s);
+
+    string filename;
+    int tempData;       // 1 = average temperature, 2 = max and min
+    bool hourly;        // sub-daily data (hour column)
+    int skip;           // data lines before the first time step
+    long nSteps;
+    long remaining;
+    ifstream in;
+    streampos dataStart;
+    deque<forcing_step> pending; // steps read ahead (incomplete day of the previous chunk)
+    string line;
+
+};
+
+/**
+ * Stochastic daily weather generator fitted on the historical forcing of
+ * each calendar month: first-order Markov chain of the wet days (above
+ * 0.1 mm), gamma distributed wet-day precipitation (method of moments) and
+ * normal temperature with AR(1) daily anomalies. The series starts at the
+ * date of the historical one and lasts the given number of years; it is
+ * the same after each rewind (same seed).
+ */
+class hbv_weather_generator : public hbv_forcing_source
+{
+public:
+
+    hbv_weather_generator(hbv_model *historical, long years, unsigned int seed);
+
+    int read(int maxSteps, int *date, double *precip, double *temp);
+    long size();
+    void rewind();
+    hbv_forcing_source *clone();
+
+protected:
+
+    static void nextDay(int *date);
+
+    // monthly statistics
+    double p01[12], p11[12];        // probability of a wet day after a dry or wet one
+    double shape[12], scale[12];    // gamma distribution of the wet-day precipitation
+    double tMean[12], tStd[12];     // temperature
+    double phi;                     // lag-1 autocorrelation of the temperature anomalies
+
+    unsigned int seed;
+    int firstDate[3];
+    long nSteps;
+
+    // current state of the series
+    mt19937 rng;
+    int date[3];
+    long remaining;
+    bool wet;
+    double anomaly;
+
+};
+}
+
+#endif // HBV_STREAM_H
@@ -0,0 +1,191 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_surrogate.h"
+#include <math.h>
+#include <limits>
+
+using namespace std;
+
+hbv_surrogate::hbv_surrogate(int nvars, int nobjs, const double *lb, const double *ub, int maxPoints)
+{
+    this->nvars = nvars;
+    this->nobjs = nobjs;
+    this->maxPoints = maxPoints;
+    this->lb.assign(lb, lb+nvars);
+    range.resize(nvars);
+    for(int j=0; j<nvars; j++) range[j] = ub[j] - lb[j];
+
+    x.resize(maxPoints*nvars);
+    f.resize(maxPoints*nobjs);
+    point.resize(nvars);
+    phi.resize(maxPoints);
+    nPoints = 0;
+    head = 0;
+    trained = false;
+    nCenters = 0;
+}
+
+hbv_surrogate::~hbv_surrogate()
+{
+}
+
+int hbv_surrogate::getSize()
+{
+    return nPoints;
+}
+
+bool hbv_surrogate::isTrained()
+{
+    return trained;
+}
+
+
+void hbv_surrogate::add(const double *vars, const double *objs)
+{
+    for(int m=0; m<nobjs; m++){
+        if(!(fabs(objs[m]) < numeric_limits<double>::max())) return;
+    }
+
+    double *p = &point[0];
+    for(int j=0; j<nvars; j++) p[j] = (vars[j] - lb[j])/range[j];
+
+    // coincident centers make the system singular
+    for(int i=0; i<nPoints; i++){
+        double d = 0.0;
+        for(int j=0; j<nvars; j++) d += (x[i*nvars+j] - p[j])*(x[i*nvars+j] - p[j]);
+        if(d < 1.0e-20) return;
+    }
+
+    for(int j=0; j<nvars; j++) x[head*nvars+j] = p[j];
+    for(int m=0; m<nobjs; m++) f[head*nobjs+m] = objs[m];
+    head = (head + 1) % maxPoints;
+    if(nPoints < maxPoints) nPoints++;
+}
+
+
+bool hbv_surrogate::train()
+{
+    // the linear tail needs at least nvars+1 points, and a few more to be meaningful
+    trained = false;
+    if(nPoints < 2*(nvars+1)) return false;
+
+    // [ Phi P ; P' 0 ] [ lambda ; c ] = [ f ; 0 ]
+    int n = nPoints + nvars + 1;
+    vector<double> a(n*n, 0.0);
+    for(int i=0; i<nPoints; i++){
+        for(int k=0; k<nPoints; k++){
+            double d = 0.0;
+            for(int j=0; j<nvars; j++) d += (x[i*nvars+j] - x[k*nvars+j])*(x[i*nvars+j] - x[k*nvars+j]);
+            d = sqrt(d);
+            a[i*n+k] = d*d*d;
+        }
+        a[i*n+nPoints] = 1.0;
+        a[nPoints*n+i] = 1.0;
+        for(int j=0; j<nvars; j++){
+            a[i*n+nPoints+1+j] = x[i*nvars+j];
+            a[(nPoints+1+j)*n+i] = x[i*nvars+j];
+        }
+    }
+
+    vector<int> pivot(n);
+    bool singular;
+    factorize(a, pivot, n, singular);
+    if(singular) return false;
+
+    nCenters = nPoints;
+    centers.assign(x.begin(), x.begin()+nPoints*nvars);
+    coef.assign(nobjs*n, 0.0);
+    for(int m=0; m<nobjs; m++){
+        double *b = &coef[m*n];
+        for(int i=0; i<nPoints; i++) b[i] = f[i*nobjs+m];
+        solve(a, pivot, n, b);
+    }
+    trained = true;
+    return true;
+}
+
+
+void hbv_surrogate::predict(const double *vars, double *objs)
+{
+    int n = nCenters + nvars + 1;
+    double *p = &point[0];
+    for(int j=0; j<nvars; j++) p[j] = (vars[j] - lb[j])/range[j];
+
+    for(int i=0; i<nCenters; i++){
+        double d = 0.0;
+        for(int j=0; j<nvars; j++) d += (centers[i*nvars+j] - p[j])*(centers[i*nvars+j] - p[j]);
+        d = sqrt(d);
+        phi[i] = d*d*d;
+    }
+
+    for(int m=0; m<nobjs; m++){
+        const double *c = &coef[m*n];
+        double y = c[nCenters];
+        for(int i=0; i<nCenters; i++) y += c[i]*phi[i];
+        for(int j=0; j<nvars; j++) y += c[nCenters+1+j]*p[j];
+        objs[m] = y;
+    }
+}
+
+
+void hbv_surrogate::factorize(vector<double> &a, vector<int> &pivot, int n, bool &singular)
+{
+    singular = false;
+    for(int k=0; k<n; k++){
+        int p = k;
+        for(int i=k+1; i<n; i++){
+            if(fabs(a[i*n+k]) > fabs(a[p*n+k])) p = i;
+        }
+        pivot[k] = p;
+        if(fabs(a[p*n+k]) < 1.0e-12){
+            singular = true;
+            return;
+        }
+        if(p != k){
+            for(int j=0; j<n; j++) swap(a[k*n+j], a[p*n+j]);
+        }
+        double *rk = &a[k*n];
+        for(int i=k+1; i<n; i++){
+            double *ri = &a[i*n];
+            double l = ri[k] / rk[k];
+            ri[k] = l;
+            if(l == 0.0) continue;
+            #pragma omp simd
+            for(int j=k+1; j<n; j++) ri[j] -= l*rk[j];
+        }
+    }
+}
+
+
+void hbv_surrogate::solve(const vector<double> &a, const vector<int> &pivot, int n, double *b)
+{
+    for(int k=0; k<n; k++){
+        if(pivot[k] != k) swap(b[k], b[pivot[k]]);
+    }
+    for(int i=1; i<n; i++){
+        double s = b[i];
+        for(int j=0; j<i; j++) s -= a[i*n+j]*b[j];
+        b[i] = s;
+    }
+    for(int i=n-1; i>=0; i--){
+        double s = b[i];
+        for(int j=i+1; j<n; j++) s -= a[i*n+j]*b[j];
+        b[i] = s/a[i*n+i];
+    }
+}
@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_SURROGATE_H
+#define HBV_SURROGATE_H
+
+#include <vector>
+
+namespace std{
+
+/**
+ * Radial basis function emulator of the objectives over the (normalized)
+ * parameter space: cubic kernel with a linear polynomial tail, one
+ * interpolant per objective sharing the same factorized system. It is
+ * trained online on the most recent exact evaluations (at most maxPoints)
+ * and used to predict the objectives of candidates before simulating them.
+ */
+class hbv_surrogate
+{
+public:
+
+    hbv_surrogate(int nvars, int nobjs, const double *lb, const double *ub, int maxPoints);
+    virtual ~hbv_surrogate();
+
+    /**
+     * add an exact evaluation (duplicates and failed runs are ignored)
+     */
+    void add(const double *vars, const double *objs);
+
+    /**
+     * fit the interpolants to the current points, false if there are not
+     * enough points or the system is singular
+     */
+    bool train();
+    bool isTrained();
+
+    /**
+     * predicted objectives of a parameter set
+     */
+    void predict(const double *vars, double *objs);
+
+    int getSize();
+
+protected:
+
+    // dense LU factorization (partial pivoting) of the row-major matrix a
+    void factorize(vector<double> &a, vector<int> &pivot, int n, bool &singular);
+    void solve(const vector<double> &a, const vector<int> &pivot, int n, double *b);
+
+    int nvars;
+    int nobjs;
+    int maxPoints;
+    vector<double> lb;
+    vector<double> range;
+
+    vector<double> x;       // normalized points (maxPoints x nvars, circular)
+    vector<double> f;       // objectives (maxPoints x nobjs)
+    int nPoints;
+    int head;               // next slot to overwrite
+
+    // fitted model on the points of the last training
+    bool trained;
+    int nCenters;
+    vector<double> centers; // nCenters x nvars
+    vector<double> coef;    // nobjs x (nCenters + nvars + 1)
+
+    // scratch buffers of add and predict (not thread-safe)
+    vector<double> point;   // normalized parameter set (nvars)
+    vector<double> phi;     // kernel values at the centers (maxPoints)
+
+};
+}
+
+#endif // HBV_SURROGATE_H
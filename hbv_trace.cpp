@@ -0,0 +1,120 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include "hbv_trace.h"
+#include <algorithm>
+
+using namespace std;
+
+hbv_trace::hbv_trace(hbv_model *model, const double *parameters, int interval)
+{
+    this->parameters.assign(parameters, parameters+hbv_model::nParams);
+    this->interval = max(interval, 1);
+    nDays = model->getData().nDays;
+    nZones = model->getData().nZones;
+    nRouting = 0;
+    nSnapshots = 0;
+
+    hbv_snapshot s;
+    model->start(&this->parameters[0]);
+    for(int day=this->interval; day<nDays; day+=this->interval){
+        model->run(day-this->interval+1, day+1);
+        model->saveState(s);
+        pack(s);
+    }
+    packed.shrink_to_fit();
+}
+
+hbv_trace::~hbv_trace()
+{
+}
+
+
+void hbv_trace::replay(hbv_model *model, int first, int last, hbv_window &w)
+{
+    first = max(first, 0);
+    last = min(last, nDays);
+    int nZones = model->getData().nZones;
+    int n = max(last - first, 0);
+    w.first = first;
+    w.last = first + n;
+    w.nZones = nZones;
+    w.sowat.resize(n*nZones);
+    w.sdep.resize(n*nZones);
+    w.stw1.resize(n);
+    w.stw2.resize(n);
+    w.Qsim.resize(n);
+    w.actualET.resize(n);
+    if(n == 0) return;
+
+    // restart from the last snapshot before the window
+    model->start(&parameters[0]);
+    int j = first > 0 ? min((first-1)/interval, nSnapshots) : 0;
+    hbv_snapshot s;
+    if(j > 0){
+        unpack(j-1, s);
+        model->loadState(s);
+    }
+
+    double *Qsim = model->getFluxes().Qsim;
+    double *actualET = model->getFluxes().actualET;
+    for(int day=j*interval; day<last; day++){
+        if(day > j*interval) model->run(day, day+1);
+        if(day < first) continue;
+
+        int k = day - first;
+        model->saveState(s);
+        copy(s.sowat.begin(), s.sowat.end(), &w.sowat[k*nZones]);
+        copy(s.sdep.begin(), s.sdep.end(), &w.sdep[k*nZones]);
+        w.stw1[k] = s.stw1;
+        w.stw2[k] = s.stw2;
+        w.Qsim[k] = Qsim[day];
+        w.actualET[k] = actualET[day];
+    }
+}
+
+
+void hbv_trace::pack(const hbv_snapshot &s)
+{
+    nRouting = s.Qrouting.size()/2;
+    packed.insert(packed.end(), s.sowat.begin(), s.sowat.end());
+    packed.insert(packed.end(), s.sdep.begin(), s.sdep.end());
+    packed.push_back(s.stw1);
+    packed.push_back(s.stw2);
+    packed.insert(packed.end(), s.Qrouting.begin(), s.Qrouting.begin()+nRouting);
+    nSnapshots++;
+}
+
+
+void hbv_trace::unpack(int k, hbv_snapshot &s)
+{
+    const double *p = &packed[k*(2*nZones + 2 + nRouting)];
+    s.day = (k+1)*interval;
+    s.sowat.assign(p, p+nZones);
+    s.sdep.assign(p+nZones, p+2*nZones);
+    s.stw1 = p[2*nZones];
+    s.stw2 = p[2*nZones+1];
+    s.Qrouting.assign(2*nRouting, 0.0);
+    copy(p+2*nZones+2, p+2*nZones+2+nRouting, s.Qrouting.begin());
+}
+
+
+size_t hbv_trace::memory()
+{
+    return sizeof(*this) + (parameters.size() + packed.capacity())*sizeof(double);
+}
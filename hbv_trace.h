@@ -0,0 +1,90 @@
+/*
+Copyright (C) 2010-2015 Matteo Giuliani, Josh Kollat, Jon Herman, and others.
+
+HBV is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+HBV is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with HBV.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+
+#ifndef HBV_TRACE_H
+#define HBV_TRACE_H
+
+#include "hbv_model.h"
+#include <vector>
+
+namespace std{
+
+/**
+ * states and fluxes of the time steps [first, last) of a run; the zone
+ * states are stored as [(step-first)*nZones + zone]
+ */
+struct hbv_window
+{
+    int first;
+    int last;
+    int nZones;
+    vector<double> sowat;
+    vector<double> sdep;
+    vector<double> stw1;
+    vector<double> stw2;
+    vector<double> Qsim;
+    vector<double> actualET;
+};
+
+/**
+ * Compact record of a run: the parameters and a snapshot of the state every
+ * `interval` time steps, instead of the trajectories of all the states and
+ * fluxes. Any window of the run is obtained by re-simulating it from the
+ * closest snapshot (at most interval-1 time steps before the window), so
+ * the memory is about interval times smaller than the full trajectories.
+ */
+class hbv_trace
+{
+public:
+
+    /**
+     * simulate the run with the model (which is then free to be reused)
+     */
+    hbv_trace(hbv_model *model, const double *parameters, int interval);
+    virtual ~hbv_trace();
+
+    /**
+     * re-simulate the time steps [first, last) with the model
+     */
+    void replay(hbv_model *model, int first, int last, hbv_window &w);
+
+    /**
+     * bytes used by the record
+     */
+    size_t memory();
+
+protected:
+
+    // snapshots are packed in a single array (only the first half of the
+    // routing buffer can be non-zero at the end of a time step)
+    void pack(const hbv_snapshot &s);
+    void unpack(int k, hbv_snapshot &s);
+
+    vector<double> parameters;
+    int interval;
+    int nDays;
+    int nZones;
+    int nRouting;           // routing values of a snapshot
+    int nSnapshots;
+    vector<double> packed;  // snapshots at the end of the time steps interval, 2*interval, ...
+
+};
+}
+
+#endif // HBV_TRACE_H
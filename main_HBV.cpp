@@ -20,72 +20,707 @@ C/C++ Version of HBV: Lumped model, one catchment. Uses Hamon ET and MOPEX forci
 *****************************************************************************/
 
 #include "hbv_model.h"
+#include "hbv_metrics.h"
+#include "hbv_signatures.h"
+#include "hbv_options.h"
+#include "hbv_pool.h"
+#include "hbv_race.h"
+#include "hbv_glue.h"
+#include "hbv_trace.h"
+#include "hbv_aggregates.h"
+#include "hbv_cache.h"
+#include "hbv_moea.h"
+#include "hbv_dream.h"
+#include "hbv_sampling.h"
+#include "hbv_batch.h"
+#include "hbv_network.h"
+#include "hbv_regional.h"
+#include "hbv_extremes.h"
+#include "hbv_enkf.h"
+#include "hbv_mpi.h"
+#include "hbv_monitor.h"
 #include "moeaframework.h"
 #include "utils.h"
 #include <math.h>
 #include <vector>
+#include <memory>
+#include <sstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
 
 using namespace std;
 
-void evaluate(double* Qobs, double* Qsim, int nDays, double* objs){
-
-    //convert observations and simulations from array to vector removing first year which is used as warm-up 
-    vector<double> Vobs(nDays, -99);
-    vector<double> Vsim(nDays, -99);
-    for(int i=366; i<Vobs.size(); i++){
-        Vobs[i] = Qobs[i];
-        Vsim[i] = Qsim[i];
-    }
-
-    // calibration using NSE decomposition from Gupta et al., 2009 
-    // (see http://www.meteo.mcgill.ca/~huardda/articles/gupta09.pdf):
-    // obj 1) minimize relative variability (alpha)
-    // obj 2) minimize absolute value of relative bias (beta)
-    // obj 3) maximize correlation coefficient (r)
-    double alpha = utils::computeStDev(Vsim) / utils::computeStDev(Vobs);
-    double beta = fabs( utils::computeMean(Vsim) - utils::computeMean(Vobs) ) / utils::computeStDev(Vobs);
-    double r = utils::computeCorr(Vsim, Vobs);
-    // 3-objective calibration
-    objs[0] = alpha;
-    objs[1] = beta;
-    objs[2] = -r;
+// parallel evaluator of the batches: full runs or race over sub-periods
+hbv_pool *createPool(hbv_model &myHBV, hbv_metrics &metrics, hbv_cache *cache, hbv_options &opt)
+{
+    hbv_pool *pool;
+    if(opt.race.empty()) pool = new hbv_pool(&myHBV, &metrics, opt.nThreads);
+    else pool = new hbv_race(&myHBV, &metrics, opt.race, opt.nThreads);
+    pool->setCache(cache);
+    return pool;
+}
+
+// states and fluxes of a window of the run, re-simulated from the closest
+// snapshot; the zone states are averaged over the basin
+void saveStates(hbv_model &myHBV, const double *vars, hbv_options &opt)
+{
+    int last = opt.windowLast < 0 ? myHBV.getData().nDays : opt.windowLast;
+    hbv_trace trace(&myHBV, vars, opt.traceInterval);
+    hbv_window w;
+    trace.replay(&myHBV, opt.windowFirst, last, w);
+
+    ofstream out(opt.statesFile.c_str(), ios::out);
+    out << "# step Qsim actualET stw1 stw2 sowat sdep" << endl << setprecision(10);
+    const double *area = myHBV.getData().zoneArea;
+    for(int k=0; k<w.last-w.first; k++){
+        double sowat = 0.0, sdep = 0.0;
+        for(int z=0; z<w.nZones; z++){
+            sowat += area[z]*w.sowat[k*w.nZones+z];
+            sdep += area[z]*w.sdep[k*w.nZones+z];
+        }
+        out << w.first+k << " " << w.Qsim[k] << " " << w.actualET[k] << " " << w.stw1[k] << " " << w.stw2[k]
+            << " " << sowat << " " << sdep << endl;
+    }
+    out.close();
+}
+
+// data assimilation: one parameter set is read from stdin, the objectives of
+// the ensemble-mean forecast are printed on stdout and the forecast, analysis
+// and spread of each time step are saved in the output file
+void runEnKF(hbv_model &myHBV, hbv_metrics &metrics, hbv_options &opt)
+{
+    double vars[hbv_model::nParams];
+    for(int j=0; j<hbv_model::nParams; j++){
+        if(!(cin >> vars[j])){
+            cout << "The enkf mode needs a parameter set on stdin" << endl;
+            exit(1);
+        }
+    }
+
+    hbv_enkf enkf(&myHBV, opt.members, opt.obsError, opt.precipError, opt.moea.seed);
+    hbv_bands *bands = NULL;
+    if(!opt.bandsFile.empty()){
+        bands = new hbv_bands(myHBV.getData().nDays, 1, opt.digestSize);
+        enkf.setBands(bands);
+    }
+    enkf.run(vars);
+    if(bands != NULL){
+        bands->write(opt.bandsFile, opt.quantiles);
+        delete bands;
+    }
+
+    int nDays = myHBV.getData().nDays;
+    vector<double> objs(metrics.size());
+    metrics.evaluate(hbv_span(enkf.getForecast(), nDays), &objs[0]);
+    cout << setprecision(17);
+    for(unsigned int m=0; m<objs.size(); m++) cout << objs[m] << (m < objs.size()-1 ? " " : "");
+    cout << endl;
+
+    if(!opt.outputFile.empty()){
+        ofstream out(opt.outputFile.c_str(), ios::out);
+        out << "# forecast analysis spread" << endl;
+        for(int t=0; t<nDays; t++){
+            out << enkf.getForecast()[t] << " " << enkf.getAnalysis()[t] << " " << enkf.getSpread()[t] << endl;
+        }
+        out.close();
+    }
+}
+
+// native calibration: the generations are evaluated in parallel and the
+// epsilon-non-dominated archive is printed on stdout
+void calibrate(hbv_model &myHBV, hbv_metrics &metrics, hbv_cache *cache, hbv_options &opt)
+{
+    hbv_pool *pool = createPool(myHBV, metrics, cache, opt);
+    hbv_moea moea(hbv_model::nParams, hbv_model::paramMin, hbv_model::paramMax, opt.moea);
+    moea.run(*pool);
+    moea.printArchive(cout);
+    moea.printSurrogateStatistics(cerr);
+    pool->printStatistics(cerr);
+    delete pool;
+}
+
+// posterior sampling: the proposals of all the chains are evaluated in
+// parallel, the samples are saved in the posterior file and the summary of
+// the posterior is printed on stdout
+void runDREAM(hbv_model &myHBV, hbv_metrics &metrics, hbv_cache *cache, hbv_options &opt)
+{
+    hbv_pool *pool = createPool(myHBV, metrics, cache, opt);
+    hbv_dream dream(hbv_model::nParams, hbv_model::paramMin, hbv_model::paramMax, opt.dream);
+    dream.run(*pool);
+    dream.printSummary(cout);
+    pool->printStatistics(cerr);
+    delete pool;
+}
+
+// bulk sampling: the rows [start, stop) of the design are evaluated in
+// parallel and the objectives are written at their row offset in a binary
+// matrix, so that separate processes (or MPI ranks) can share the same file
+void runBulk(hbv_model &myHBV, hbv_metrics &metrics, hbv_cache *cache, hbv_options &opt)
+{
+    int nvars = hbv_model::nParams;
+    int nobjs = metrics.size();
+    hbv_design design(opt.design, nvars, hbv_model::paramMin, hbv_model::paramMax, opt.nSamples, opt.moea.seed);
+    long start = opt.shardStart;
+    long stop = opt.shardStop < 0 ? design.size() : min(opt.shardStop, design.size());
+    if(opt.resultsFile.empty() || start < 0 || start > stop){
+        cout << "The bulk mode needs --results and a valid range of rows (--start, --stop)" << endl;
+        exit(1);
+    }
+    if(!opt.bandsFile.empty() && !opt.race.empty()){
+        cout << "--bands needs the flows of full runs (no --race)" << endl;
+        exit(1);
+    }
+
+#ifdef HBV_MPI
+    // the ranks split the range evenly
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    long n = stop - start;
+    stop = start + n*(rank+1)/size;
+    start = start + n*rank/size;
+#endif
+
+    // the file is extended (never truncated) to the size of the whole design
+    int fd = open(opt.resultsFile.c_str(), O_RDWR | O_CREAT, 0644);
+    off_t fileSize = (off_t)design.size()*nobjs*sizeof(double);
+    if(fd < 0 || (lseek(fd, 0, SEEK_END) < fileSize && ftruncate(fd, fileSize) != 0)){
+        cout << "The results file " << opt.resultsFile << " could not be created" << endl;
+        exit(1);
+    }
+
+    hbv_pool *pool = createPool(myHBV, metrics, cache, opt);
+    hbv_bands *bands = NULL;
+    if(!opt.bandsFile.empty()){
+        bands = new hbv_bands(myHBV.getData().nDays, pool->getNumberOfThreads(), opt.digestSize);
+        pool->setBands(bands);
+    }
+    long chunk = 64*pool->getNumberOfThreads();
+    vector<double> vars(chunk*nvars);
+    vector<double> objs(chunk*nobjs);
+    for(long row=start; row<stop; row+=chunk){
+        int n = min(chunk, stop-row);
+        for(int i=0; i<n; i++) design.get(row+i, &vars[i*nvars]);
+        pool->evaluate(n, &vars[0], &objs[0]);
+        size_t bytes = (size_t)n*nobjs*sizeof(double);
+        if(pwrite(fd, &objs[0], bytes, (off_t)row*nobjs*sizeof(double)) != (ssize_t)bytes){
+            cout << "Error writing the results file " << opt.resultsFile << endl;
+            exit(1);
+        }
+    }
+    close(fd);
+    pool->printStatistics(cerr);
+    delete pool;
+
+    // quantile bands of the flows of all the rows (merged on rank 0)
+    if(bands != NULL){
+#ifdef HBV_MPI
+        hbv_mpi_reduce(*bands);
+        if(rank == 0)
+#endif
+        bands->write(opt.bandsFile, opt.quantiles);
+        delete bands;
+    }
+}
+
+// GLUE: the rows [start, stop) of the design are evaluated in parallel, the
+// behavioural ones are printed on stdout (parameters, objectives and weight)
+// and the weighted quantiles of their flows at each time step are saved in
+// the output file
+void runGLUE(hbv_model &myHBV, hbv_metrics &metrics, hbv_options &opt)
+{
+    int nvars = hbv_model::nParams;
+    int nobjs = metrics.size();
+    hbv_design design(opt.design, nvars, hbv_model::paramMin, hbv_model::paramMax, opt.nSamples, opt.moea.seed);
+    long start = opt.shardStart;
+    long stop = opt.shardStop < 0 ? design.size() : min(opt.shardStop, design.size());
+    if(opt.outputFile.empty() || start < 0 || start > stop || opt.quantiles.empty()){
+        cout << "The glue mode needs an output file, a valid range of rows (--start, --stop) and --quantiles" << endl;
+        exit(1);
+    }
+
+    hbv_glue glue(&myHBV, &metrics, opt.behavioural, opt.nThreads);
+    hbv_bands bands(myHBV.getData().nDays, glue.getNumberOfThreads(), opt.digestSize);
+    glue.setBands(&bands);
+    long chunk = 64*glue.getNumberOfThreads();
+    vector<double> vars(chunk*nvars);
+    vector<double> objs(chunk*nobjs);
+    cout << setprecision(10);
+    for(long row=start; row<stop; row+=chunk){
+        int n = min(chunk, stop-row);
+        for(int i=0; i<n; i++) design.get(row+i, &vars[i*nvars]);
+        glue.evaluate(n, &vars[0], &objs[0]);
+        const double *w = glue.getWeights();
+        for(int i=0; i<n; i++){
+            if(w[i] <= 0.0) continue;
+            for(int j=0; j<nvars; j++) cout << vars[i*nvars+j] << " ";
+            for(int m=0; m<nobjs; m++) cout << objs[i*nobjs+m] << " ";
+            cout << w[i] << endl;
+        }
+    }
+
+    // prediction bounds, and fraction of the observations within the outer ones
+    int nDays = myHBV.getData().nDays;
+    int nq = opt.quantiles.size();
+    vector<double> b;
+    bands.write(opt.outputFile, opt.quantiles);
+    bands.quantiles(opt.quantiles, b);
+    const double *Qobs = myHBV.getData().flow;
+    int observed = 0, covered = 0;
+    for(int t=myHBV.getWarmup(); t<nDays; t++){
+        if(Qobs[t] >= 0.0 && b[(size_t)t*nq] == b[(size_t)t*nq]){
+            observed++;
+            if(Qobs[t] >= b[(size_t)t*nq] && Qobs[t] <= b[(size_t)t*nq+nq-1]) covered++;
+        }
+    }
+    glue.printStatistics(cerr);
+    cerr << "glue: " << (observed > 0 ? 100.0*covered/observed : 0.0) << "% of the observed flows within the bounds q"
+         << opt.quantiles[0] << "-q" << opt.quantiles[nq-1] << endl;
+}
+
+// regional parameter sets: each parameter set read with the MOEA Framework
+// protocol is simulated on all the catchments of the manifest in parallel,
+// and their aggregated objectives are written back in one MOEA_Write
+void runRegional(hbv_options &opt)
+{
+    hbv_regional regional(opt.inputFile, opt.objectives, opt.aggregate, opt.nThreads);
+    int nobjs = regional.getNumberOfObjectives();
+    vector<double> objs(nobjs);
+    double vars[hbv_model::nParams];
+
+    MOEA_Init(nobjs, 0);
+    while (MOEA_Next_solution() == MOEA_SUCCESS) {
+        MOEA_Read_doubles(hbv_model::nParams, vars);
+        regional.evaluate(1, vars, &objs[0]);
+        MOEA_Write(&objs[0], NULL);
+    }
+}
+
+// flood frequency analysis: the parameter sets read from stdin are simulated
+// on the streamed (or synthetic) forcing, and the distributions fitted to
+// their extremes are printed on stdout
+void runExtremes(hbv_options &opt)
+{
+    vector<double> vars;
+    double x;
+    while(cin >> x) vars.push_back(x);
+    int nSets = vars.size() / hbv_model::nParams;
+    if(nSets == 0){
+        cout << "The extremes mode needs parameter sets on stdin" << endl;
+        exit(1);
+    }
+
+    hbv_extremes extremes(opt.inputFile, opt.extremes);
+    extremes.run(nSets, &vars[0], opt.nThreads);
+    extremes.print(cout);
+}
+
+// climate stress test: every parameter set read from stdin is evaluated
+// under every scenario (delta changes applied on the fly to the shared
+// forcing), one row per scenario and parameter set on stdout
+void runScenarios(hbv_model &myHBV, hbv_metrics &metrics, hbv_options &opt)
+{
+    vector<double> vars;
+    double x;
+    while(cin >> x) vars.push_back(x);
+    int nSets = vars.size() / hbv_model::nParams;
+
+    ifstream in(opt.scenarioFile.c_str(), ios::in);
+    if(!in || nSets == 0){
+        cout << "The scenarios mode needs --scenarios and parameter sets on stdin" << endl;
+        exit(1);
+    }
+    vector<hbv_scenario> scenarios;
+    string line;
+    while(getline(in, line)){
+        stringstream ss(line);
+        vector<double> v;
+        while(ss >> x) v.push_back(x);
+        if(v.empty()) continue;
+        if(v.size() != 2 && v.size() != 24){
+            cout << "Invalid scenario (2 or 24 values): " << line << endl;
+            exit(1);
+        }
+        hbv_scenario s;
+        for(int m=0; m<12; m++){
+            s.precipFactor[m] = v.size() == 2 ? v[0] : v[m];
+            s.tempDelta[m] = v.size() == 2 ? v[1] : v[12+m];
+        }
+        scenarios.push_back(s);
+    }
+
+    // the pool of each scenario shares its forcing view and PE
+    int nobjs = metrics.size();
+    vector<double> objs(nSets*nobjs);
+    cout << setprecision(17);
+    for(unsigned int k=0; k<scenarios.size(); k++){
+        hbv_model scenario(&myHBV, scenarios[k]);
+        scenario.setStoreStates(false);
+        hbv_pool pool(&scenario, &metrics, opt.nThreads);
+        pool.evaluate(nSets, &vars[0], &objs[0]);
+        for(int i=0; i<nSets; i++){
+            cout << k << " " << i;
+            for(int m=0; m<nobjs; m++) cout << " " << objs[i*nobjs+m];
+            cout << endl;
+        }
+        scenario.hbv_delete(scenario.getData().nDays);
+    }
 }
 
+#ifdef HBV_MPI
+// true if the next read from stdin does not block (data or end of input)
+static bool inputReady()
+{
+    struct pollfd fd;
+    fd.fd = fileno(stdin);
+    fd.events = POLLIN;
+    return poll(&fd, 1, 0) > 0;
+}
+
+// MPI run: rank 0 reads the parameter sets (or runs the calibration) and
+// distributes them to the workers, which hold their own copy of the forcing
+void runMPI(hbv_model &myHBV, hbv_metrics &metrics, hbv_cache *cache, hbv_options &opt)
+{
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    if(rank > 0){
+        hbv_pool *pool = createPool(myHBV, metrics, cache, opt);
+        hbv_mpi_worker(*pool);
+        delete pool;
+        return;
+    }
+
+    hbv_mpi_evaluator evaluator(metrics.size(), opt.blockSize);
+    if(opt.mode == "moea"){
+        hbv_moea moea(hbv_model::nParams, hbv_model::paramMin, hbv_model::paramMax, opt.moea);
+        moea.run(evaluator);
+        moea.printArchive(cout);
+        moea.printSurrogateStatistics(cerr);
+        evaluator.terminate();
+        return;
+    }
+    if(opt.mode == "dream"){
+        hbv_dream dream(hbv_model::nParams, hbv_model::paramMin, hbv_model::paramMax, opt.dream);
+        dream.run(evaluator);
+        dream.printSummary(cout);
+        evaluator.terminate();
+        return;
+    }
+
+    // parameter sets are read from stdin in chunks and evaluated by the workers
+    if(!opt.bandsFile.empty()){
+        cout << "--bands is not available with the MPI workers in simulation mode (use --mode bulk)" << endl;
+        evaluator.terminate();
+        return;
+    }
+    if(!opt.monthlyFile.empty() || !opt.annualFile.empty() || !opt.signatureFile.empty()){
+        cout << "--monthly, --annual and --signatures are not available with the MPI workers in simulation mode (use SimHBV)" << endl;
+        evaluator.terminate();
+        return;
+    }
+    int nobjs = evaluator.getNumberOfObjectives();
+    int nvars = hbv_model::nParams;
+    int chunk = 10000;
+    // a pipe or a socket (e.g. a driver waiting for each result before sending
+    // the next parameter set) is read unbuffered, and the sets already read are
+    // evaluated as soon as no more input is ready; a file is read in chunks
+    struct stat st;
+    bool interactive = fstat(fileno(stdin), &st) != 0 || !S_ISREG(st.st_mode);
+    if(interactive) setvbuf(stdin, NULL, _IONBF, 0);
+    vector<double> vars(chunk*nvars);
+    vector<double> objs(chunk*nobjs);
+    vector<double> last;
+    bool more = true;
+    int n = 0;
+
+    MOEA_Init(nobjs, 0);
+    while(more){
+        n = 0;
+        while(n < chunk && (more = (MOEA_Next_solution() == MOEA_SUCCESS))){
+            MOEA_Read_doubles(nvars, &vars[n*nvars]);
+            n++;
+            if(interactive && !inputReady()) break;
+        }
+        evaluator.evaluate(n, &vars[0], &objs[0]);
+        for(int i=0; i<n; i++){
+            MOEA_Write(&objs[i*nobjs], NULL);
+        }
+        // keep the last parameter set for the simulated flows
+        if(n > 0) last.assign(&vars[(n-1)*nvars], &vars[n*nvars]);
+    }
+    evaluator.terminate();
+
+    // save simulation results (last parameter set, as in the serial run)
+    if(!opt.outputFile.empty() && !last.empty()){
+        myHBV.calc_HBV(&last[0]);
+        utils::logArray(myHBV.getFluxes().Qsim, myHBV.getData().nDays, opt.outputFile);
+    }
+    if(!opt.statesFile.empty() && !last.empty()){
+        saveStates(myHBV, &last[0], opt);
+    }
+}
+#endif
 
 
 int main(int argc, char **argv)
 {
     // read user input: single input for calibration, two inputs for simulation
-    string input_file = argv[1];
-    string output_file;
-    if(argc>2){
-        output_file = argv[2];
+    hbv_options opt;
+    parseOptions(argc, argv, opt);
+    string input_file = opt.inputFile;
+    string output_file = opt.outputFile;
+
+#ifdef HBV_MPI
+    MPI_Init(&argc, &argv);
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    // one thread per rank unless specified
+    if(opt.nThreads <= 0) opt.nThreads = 1;
+#endif
+
+    // metrics endpoint (one per MPI rank), stopped when main returns
+    unique_ptr<hbv_monitor> monitor;
+    if(!opt.monitor.empty()){
+        string address = opt.monitor;
+#ifdef HBV_MPI
+        int monitorRank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &monitorRank);
+        stringstream ss;
+        if(address.compare(0, 5, "unix:") != 0) ss << atoi(address.c_str()) + monitorRank;
+        else if(monitorRank > 0) ss << address << "." << monitorRank;
+        else ss << address;
+        address = ss.str();
+#endif
+        monitor.reset(new hbv_monitor(address));
+    }
+
+    // batch of catchments: the input file is the manifest (shared memory only)
+    if(opt.mode == "batch"){
+#ifdef HBV_MPI
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if(rank == 0)
+#endif
+        {
+            hbv_batch batch(input_file, opt.objectives, opt.blockSize, opt.moea.seed);
+            batch.run(opt.nThreads, opt.affinity);
+        }
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+    // river network: the input file lists the sub-basins (shared memory only)
+    if(opt.mode == "network"){
+#ifdef HBV_MPI
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if(rank == 0)
+#endif
+        {
+            hbv_network network(input_file);
+            network.run(opt.nThreads, opt.affinity);
+            if(!output_file.empty()) network.write(output_file);
+        }
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+    // regional parameter sets: the input file lists the catchments (shared memory only)
+    if(opt.mode == "regional"){
+#ifdef HBV_MPI
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if(rank == 0)
+#endif
+        runRegional(opt);
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+    // long series: the forcing is streamed, never loaded (shared memory only)
+    if(opt.mode == "extremes"){
+#ifdef HBV_MPI
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if(rank == 0)
+#endif
+        runExtremes(opt);
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
     }
 
     // hbv model
     hbv_model myHBV(input_file);
+    myHBV.setStoreStates(opt.storeStates);
+    myHBV.setFastPow(opt.fastPow);
+
+    // performance metrics (objectives)
+    hbv_span Qobs(myHBV.getData().flow, myHBV.getData().nDays);
+    hbv_span precip(myHBV.getData().precip, myHBV.getData().nDays);
+    hbv_metrics metrics(opt.objectives, Qobs, precip, myHBV.getWarmup());
+
+    // results of previous runs
+    hbv_cache *cache = NULL;
+    if(!opt.cacheFile.empty()){
+        cache = new hbv_cache(opt.cacheFile, input_file, opt.objectives, metrics.size(), opt.cacheResolution, opt.cacheTraces, opt.fastPow);
+    }
+
+    if(opt.mode == "bulk"){
+        runBulk(myHBV, metrics, cache, opt);
+        delete cache;
+        myHBV.hbv_delete(myHBV.getData().nDays);
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+    if(opt.mode == "enkf" || opt.mode == "glue" || opt.mode == "scenarios"){
+#ifdef HBV_MPI
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if(rank == 0)
+#endif
+        {
+            if(opt.mode == "enkf") runEnKF(myHBV, metrics, opt);
+            else if(opt.mode == "glue") runGLUE(myHBV, metrics, opt);
+            else runScenarios(myHBV, metrics, opt);
+        }
+        delete cache;
+        myHBV.hbv_delete(myHBV.getData().nDays);
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
+
+#ifdef HBV_MPI
+    if(size > 1){
+        runMPI(myHBV, metrics, cache, opt);
+        delete cache;
+        myHBV.hbv_delete(myHBV.getData().nDays);
+        MPI_Finalize();
+        return 0;
+    }
+#endif
+
+    if(opt.mode == "moea" || opt.mode == "dream"){
+        if(opt.mode == "moea") calibrate(myHBV, metrics, cache, opt);
+        else runDREAM(myHBV, metrics, cache, opt);
+        delete cache;
+        myHBV.hbv_delete(myHBV.getData().nDays);
+#ifdef HBV_MPI
+        MPI_Finalize();
+#endif
+        return 0;
+    }
 
     // calibration settings
-    int nobjs = 3;
-    int nvars = 12;
-    double objs[nobjs];
+    int nobjs = metrics.size();
+    int nvars = hbv_model::nParams;
+    vector<double> objs(nobjs);
     double vars[nvars];
 
+    // hydrologic signatures of each run (first row: observations)
+    hbv_signatures *signatures = NULL;
+    ofstream sigFile;
+    double sig[hbv_signatures::NSIGNATURES];
+    if(!opt.signatureFile.empty()){
+        signatures = new hbv_signatures(Qobs, precip, myHBV.getWarmup());
+        sigFile.open(opt.signatureFile.c_str(), ios::out);
+        sigFile << "#";
+        for(int k=0; k<hbv_signatures::NSIGNATURES; k++) sigFile << " " << hbv_signatures::names[k];
+        sigFile << endl << setprecision(10);
+        for(int k=0; k<hbv_signatures::NSIGNATURES; k++) sigFile << signatures->getObserved(k) << " ";
+        sigFile << endl;
+    }
+
+    // monthly and annual aggregates of each run
+    hbv_aggregates *aggregates = NULL;
+    if(!opt.monthlyFile.empty() || !opt.annualFile.empty()){
+        aggregates = new hbv_aggregates(&myHBV, opt.monthlyFile, opt.annualFile);
+    }
+
+    // quantile bands of the flows of all the parameter sets
+    hbv_bands *bands = NULL;
+    if(!opt.bandsFile.empty()) bands = new hbv_bands(myHBV.getData().nDays, 1, opt.digestSize);
+
+    bool simulated = true; // false if the last parameter set was found in the cache
+    hbv_cache_key key;
+
     MOEA_Init(nobjs, 0);
     while (MOEA_Next_solution() == MOEA_SUCCESS) {
         MOEA_Read_doubles(nvars, vars);
-        myHBV.calc_HBV(vars);
-        evaluate(myHBV.getData().flow, myHBV.getFluxes().Qsim, myHBV.getData().nDays, objs);
-        MOEA_Write(objs, NULL);
+        if(cache != NULL){
+            key = cache->makeKey(vars);
+            simulated = !cache->lookup(key, &objs[0]);
+        }
+        if(simulated){
+            chrono::steady_clock::time_point t0 = hbv_stats::start();
+            if(aggregates != NULL) aggregates->run(vars);
+            else myHBV.calc_HBV(vars);
+            metrics.evaluate(hbv_span(myHBV.getFluxes().Qsim, myHBV.getData().nDays), &objs[0]);
+            hbv_stats::evaluation(t0, myHBV.getData().nDays);
+            if(cache != NULL) cache->insert(key, &objs[0], myHBV.getFluxes().Qsim, myHBV.getData().nDays);
+        }
+        MOEA_Write(&objs[0], NULL);
+        if(aggregates != NULL && !simulated){
+            aggregates->run(vars);
+            simulated = true;
+        }
+        if(signatures != NULL){
+            if(!simulated){
+                myHBV.calc_HBV(vars);
+                simulated = true;
+            }
+            signatures->compute(hbv_span(myHBV.getFluxes().Qsim, myHBV.getData().nDays), sig);
+            for(int k=0; k<hbv_signatures::NSIGNATURES; k++) sigFile << sig[k] << " ";
+            sigFile << endl;
+        }
+        if(bands != NULL){
+            if(!simulated){
+                myHBV.calc_HBV(vars);
+                simulated = true;
+            }
+            bands->add(0, myHBV.getFluxes().Qsim);
+        }
     }
+    if(signatures != NULL){
+        sigFile.close();
+        delete signatures;
+    }
+    if(bands != NULL){
+        bands->write(opt.bandsFile, opt.quantiles);
+        delete bands;
+    }
+    delete aggregates;
 
     // save simulation results
-    if(argc>2){
+    if(!output_file.empty()){
+        if(!simulated) myHBV.calc_HBV(vars);
         utils::logArray(myHBV.getFluxes().Qsim, myHBV.getData().nDays, output_file);
     }
+    if(!opt.statesFile.empty()){
+        saveStates(myHBV, vars, opt);
+    }
 
     // clear HBV
+    delete cache;
     myHBV.hbv_delete(myHBV.getData().nDays);
 
+#ifdef HBV_MPI
+    MPI_Finalize();
+#endif
     return 0;
 }
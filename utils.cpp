@@ -192,7 +192,7 @@ double utils::cubicFeetToAcreFeet(double x){
 
 
 
-double utils::computeSum(vector<double> g){
+double utils::computeSum(const vector<double> &g){
     double z = 0.0;
     for(unsigned int i=0; i<g.size(); i++){
         z = z + g[i];
@@ -200,7 +200,7 @@ double utils::computeSum(vector<double> g){
     return z;
 }
 
-double utils::computeMax(vector<double> g){
+double utils::computeMax(const vector<double> &g){
     double m = -1*numeric_limits<double>::max( );
     for(unsigned int i=0; i<g.size(); i++){
         if(g[i]>m){
@@ -210,7 +210,7 @@ double utils::computeMax(vector<double> g){
     return m;
 }
 
-double utils::computeMin(vector<double> g){
+double utils::computeMin(const vector<double> &g){
     double m = numeric_limits<double>::max( );
     for(unsigned int i=0; i<g.size(); i++){
         if(g[i]<m){
@@ -220,12 +220,12 @@ double utils::computeMin(vector<double> g){
     return m;
 }
 
-double utils::computeMean(vector<double> g){
+double utils::computeMean(const vector<double> &g){
     double z = computeSum(g)/g.size();
     return z;
 }
 
-double utils::computeVariance(vector<double> g){
+double utils::computeVariance(const vector<double> &g){
     double v = 0.0;
     double M = computeMean(g);
     for(unsigned int i=0; i<g.size(); i++){
@@ -234,13 +234,13 @@ double utils::computeVariance(vector<double> g){
     return v/g.size();
 }
 
-double utils::computeStDev(vector<double> g){
+double utils::computeStDev(const vector<double> &g){
     double v = computeVariance(g);
     double s = sqrt(v);
     return s;
 }
 
-double utils::computeCov(vector<double> x, vector<double> y){
+double utils::computeCov(const vector<double> &x, const vector<double> &y){
     double x_mean = computeMean(x);
     double y_mean = computeMean(y);
 
@@ -253,7 +253,7 @@ double utils::computeCov(vector<double> x, vector<double> y){
     return cov;
 }
 
-double utils::computeCorr(vector<double> x, vector<double> y){
+double utils::computeCorr(const vector<double> &x, const vector<double> &y){
     double cov = computeCov(x, y);
     double x_std = computeStDev(x);
     double y_std = computeStDev(y);
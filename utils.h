@@ -84,14 +84,14 @@ public:
     /**
       * Basic operations on vector
       */
-    static double computeSum(vector<double> g);
-    static double computeMax(vector<double> g);
-    static double computeMin(vector<double> g);
-    static double computeMean(vector<double> g);
-    static double computeVariance(vector<double> g);
-    static double computeStDev(vector<double> g);
-    static double computeCov(vector<double> x, vector<double> y);
-    static double computeCorr(vector<double> x, vector<double> y);
+    static double computeSum(const vector<double> &g);
+    static double computeMax(const vector<double> &g);
+    static double computeMin(const vector<double> &g);
+    static double computeMean(const vector<double> &g);
+    static double computeVariance(const vector<double> &g);
+    static double computeStDev(const vector<double> &g);
+    static double computeCov(const vector<double> &x, const vector<double> &y);
+    static double computeCorr(const vector<double> &x, const vector<double> &y);
 
     /**
       * Normalization and De-normalization